@@ -6,6 +6,7 @@
 #pragma once
 
 #include <dtest_core/test.h>
+#include <dtest_core/allocator.h>
 
 using Status = dtest::Test::Status;
 
@@ -51,6 +52,26 @@ using Status = dtest::Test::Status;
 
 ////
 
+#include <dtest_core/scaling_test.h>
+
+#ifdef DTEST_DISABLE_ALL
+#define scalingTest(...) __test__(dtest::ScalingTest, __VA_ARGS__).disable()
+#else
+#define scalingTest(...) __test__(dtest::ScalingTest, __VA_ARGS__)
+#endif
+
+////
+
+#include <dtest_core/load_test.h>
+
+#ifdef DTEST_DISABLE_ALL
+#define loadTest(...) __test__(dtest::LoadTest, __VA_ARGS__).disable()
+#else
+#define loadTest(...) __test__(dtest::LoadTest, __VA_ARGS__)
+#endif
+
+////
+
 #include <dtest_core/distributed_unit_test.h>
 
 #ifdef DTEST_DISABLE_ALL
@@ -76,3 +97,48 @@ using Status = dtest::Test::Status;
 #include <dtest_core/time_of.h>
 
 #define dtest_timeOf(code) dtest::timeOf(code)
+#define dtest_do_not_optimize(x) dtest::doNotOptimize(x)
+#define dtest_clobber_memory() dtest::clobberMemory()
+
+////
+
+#include <dtest_core/latency.h>
+
+#define dtest_record_latency(nanos) dtest::recordLatency(nanos)
+
+#define dtest_time_latency \
+    for ( \
+        dtest::LatencyTimer __dtest_concat(__latency_timer__uid_, __LINE__); \
+        __dtest_concat(__latency_timer__uid_, __LINE__).once(); \
+    )
+
+////
+
+#include <dtest_core/memory.h>
+
+#define dtest_alloc_budget(maxBlocks, maxBytes) \
+    for ( \
+        dtest::AllocationBudget __dtest_concat(__alloc_budget__uid_, __LINE__)(maxBlocks, maxBytes); \
+        __dtest_concat(__alloc_budget__uid_, __LINE__).once(); \
+    )
+
+#define dtest_no_alloc dtest_alloc_budget(0, 0)
+
+#define dtest_heap_snapshot() dtest::sandbox().heapSnapshot()
+#define dtest_heap_diff(a, b) dtest::sandbox().heapDiff(a, b)
+
+////
+
+#include <dtest_core/annotations.h>
+
+#if defined(DTEST_DISABLE_ALL) || defined(DTEST_DISABLE_ANNOTATIONS)
+#define dtest_track_alloc(pool, ptr, size) ((void) 0)
+#define dtest_track_free(pool, ptr) ((void) 0)
+#define dtest_pool_reset(pool) ((void) 0)
+#define dtest_pool_name(pool, name) ((void) 0)
+#else
+#define dtest_track_alloc(pool, ptr, size) dtest::trackPoolAlloc(pool, ptr, size)
+#define dtest_track_free(pool, ptr) dtest::trackPoolFree(pool, ptr)
+#define dtest_pool_reset(pool) dtest::resetPool(pool)
+#define dtest_pool_name(pool, name) dtest::namePool(pool, name)
+#endif
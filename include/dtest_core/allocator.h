@@ -0,0 +1,44 @@
+/*
+ * Copyright (c) 2021 Noah Orensa.
+ * Licensed under the MIT license. See LICENSE file in the project root for details.
+*/
+
+#pragma once
+
+#include <cstddef>
+
+namespace dtest {
+
+enum class Allocator {
+    LIBC,           // the allocator dtest is linked against
+    ARENA,          // bump-pointer arena, frees are no-ops
+    THREAD_CACHE,   // size classes with per-thread free lists
+    TUNED_LIBC      // libc, with mmap and trimming thresholds raised
+};
+
+// allocator serving the hooked malloc family while it is in use
+class AllocatorBackend {
+public:
+
+    virtual ~AllocatorBackend() = default;
+
+    virtual void activate() { }
+
+    virtual void deactivate() { }
+
+    // alignment is a power of two, or 0 for the default malloc alignment
+    virtual void * allocate(size_t size, size_t alignment) = 0;
+
+    virtual void release(void *ptr) = 0;
+
+    virtual size_t usableSize(void *ptr) = 0;
+};
+
+// routes allocations to the given backend until another one is used
+void useAllocator(Allocator allocator);
+
+// the backend that allocated the given block, or nullptr for libc blocks.
+// Blocks keep being freed by their backend after it is no longer in use.
+AllocatorBackend * allocatorOf(const void *ptr);
+
+}  // end namespace dtest
@@ -0,0 +1,23 @@
+/*
+ * Copyright (c) 2021 Noah Orensa.
+ * Licensed under the MIT license. See LICENSE file in the project root for details.
+*/
+
+#pragma once
+
+#include <stddef.h>
+
+namespace dtest {
+
+// report blocks handed out by a user-managed pool or arena, so that they
+// show up in leak reports and pool usage, attributed to the pool
+void trackPoolAlloc(const void *pool, void *ptr, size_t size);
+
+void trackPoolFree(const void *pool, void *ptr);
+
+// releases every block of the pool, e.g. when an arena is rewound
+void resetPool(const void *pool);
+
+void namePool(const void *pool, const char *name);
+
+}  // end namespace dtest
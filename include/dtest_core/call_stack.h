@@ -6,6 +6,7 @@
 #pragma once
 
 #include <string>
+#include <functional>
 
 namespace dtest {
 
@@ -13,6 +14,8 @@ class CallStack {
 private:
     static const int _MAX_STACK_FRAMES = 32;
 
+    static bool _raw;
+
     int _len = 0;
     void **_stack = nullptr;
     int _skip = 0;
@@ -41,6 +44,8 @@ private:
 
 public:
 
+    inline CallStack() { }
+
     inline CallStack(const CallStack &rhs) {
         _copy(rhs);
     }
@@ -52,6 +57,10 @@ public:
 
     static CallStack trace(int skip = 0);
 
+    // captures up to depth frames into a caller-provided buffer, returning the
+    // number of frames captured
+    static int shallowTrace(void **frames, int depth, int skip = 0);
+
     inline ~CallStack() {
         _dispose();
         _invalidate();
@@ -79,6 +88,43 @@ public:
     void * const * stack() const {
         return _stack + _skip;
     }
+
+    inline int size() const {
+        return _len - _skip;
+    }
+
+    size_t hash() const noexcept;
+
+    bool operator==(const CallStack &rhs) const noexcept;
+
+    static std::string symbolName(void *address) noexcept;
+
+    // in raw mode, frames are written as addresses within their module
+    // instead of being symbolized, to be resolved later by symbolize()
+    static inline void rawMode(bool val) {
+        _raw = val;
+    }
+
+    static inline bool rawMode() {
+        return _raw;
+    }
+
+    // address ranges and paths of the loaded modules, as a JSON array
+    static std::string moduleMap();
+
+    // replaces the raw frames found in text with symbolized frames
+    static std::string symbolize(const std::string &text);
+};
+
+}  // end namespace dtest;
+
+namespace std {
+
+template <>
+struct hash<dtest::CallStack> {
+    inline size_t operator()(const dtest::CallStack &callstack) const noexcept {
+        return callstack.hash();
+    }
 };
 
-}  // end namespace dtest;
\ No newline at end of file
+}  // end namespace std
\ No newline at end of file
@@ -0,0 +1,85 @@
+/*
+ * Copyright (c) 2021 Noah Orensa.
+ * Licensed under the MIT license. See LICENSE file in the project root for details.
+*/
+
+#pragma once
+
+#include <string>
+#include <cstdint>
+
+namespace dtest {
+
+// event counts of the process, and of the threads it creates after the
+// counters are opened
+struct CounterValues {
+    enum Event {
+        CYCLES,
+        INSTRUCTIONS,
+        CACHE_REFERENCES,
+        CACHE_MISSES,
+        BRANCH_MISSES,
+        DTLB_MISSES,
+        TASK_CLOCK,
+        CONTEXT_SWITCHES,
+        PAGE_FAULTS,
+        EVENTS
+    };
+
+    // bit i is set if event i was counted
+    uint32_t valid = 0;
+    uint64_t value[EVENTS] = { };
+
+    inline bool has(Event e) const {
+        return valid & (1u << e);
+    }
+
+    inline bool hardware() const {
+        return has(CYCLES) || has(INSTRUCTIONS);
+    }
+
+    CounterValues operator-(const CounterValues &other) const;
+
+    CounterValues & operator+=(const CounterValues &other);
+
+    // counts are divided by n, e.g. the number of body runs
+    std::string report(double n = 1) const;
+};
+
+// reads hardware counters through perf_event_open. Where the PMU is not
+// available, e.g. in a VM or due to perf_event_paranoid, only the software
+// events are counted, from perf_event_open if possible and from getrusage
+// otherwise.
+class Counters {
+private:
+
+    int _fd[CounterValues::EVENTS];
+    bool _open = false;
+
+    static int _openEvent(uint32_t type, uint64_t config, bool kernel = false);
+
+public:
+
+    Counters();
+
+    Counters(const Counters &) = delete;
+
+    Counters & operator=(const Counters &) = delete;
+
+    inline ~Counters() {
+        close();
+    }
+
+    void open();
+
+    void close();
+
+    inline bool isOpen() const {
+        return _open;
+    }
+
+    // current counts, since the counters were opened
+    void read(CounterValues &values) const;
+};
+
+}  // end namespace dtest
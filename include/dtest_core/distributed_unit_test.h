@@ -121,6 +121,61 @@ public:
         return *this;
     }
 
+    inline DistributedUnitTest & heapProfile(size_t topN = 10) {
+        UnitTest::heapProfile(topN);
+        return *this;
+    }
+
+    inline DistributedUnitTest & heapProfileExport(const std::string &prefix) {
+        UnitTest::heapProfileExport(prefix);
+        return *this;
+    }
+
+    inline DistributedUnitTest & memoryTimeline(size_t topN = 5) {
+        UnitTest::memoryTimeline(topN);
+        return *this;
+    }
+
+    inline DistributedUnitTest & allocationHistograms(size_t topN = 5) {
+        UnitTest::allocationHistograms(topN);
+        return *this;
+    }
+
+    inline DistributedUnitTest & allocatorOverhead(bool val = true) {
+        UnitTest::allocatorOverhead(val);
+        return *this;
+    }
+
+    inline DistributedUnitTest & crossThreadFrees(size_t topN = 5) {
+        UnitTest::crossThreadFrees(topN);
+        return *this;
+    }
+
+    inline DistributedUnitTest & stackProfile(bool val = true) {
+        UnitTest::stackProfile(val);
+        return *this;
+    }
+
+    inline DistributedUnitTest & stackBytesLimit(size_t bytes) {
+        UnitTest::stackBytesLimit(bytes);
+        return *this;
+    }
+
+    inline DistributedUnitTest & workingSet(bool val = true) {
+        UnitTest::workingSet(val);
+        return *this;
+    }
+
+    inline DistributedUnitTest & counters(bool val = true) {
+        UnitTest::counters(val);
+        return *this;
+    }
+
+    inline DistributedUnitTest & allocator(Allocator allocator) {
+        UnitTest::allocator(allocator);
+        return *this;
+    }
+
     inline DistributedUnitTest & disable() {
         UnitTest::disable();
         return *this;
@@ -0,0 +1,111 @@
+/*
+ * Copyright (c) 2021 Noah Orensa.
+ * Licensed under the MIT license. See LICENSE file in the project root for details.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace dtest {
+
+struct HeapSnapshot {
+    uint64_t index = 0;     // allocations made before the snapshot
+};
+
+// blocks allocated between two snapshots and still live, grouped by
+// allocation site. Storage is allocated outside of memory tracking, so that a
+// diff does not show up in the next one.
+class HeapDiff {
+
+    friend class Memory;
+
+public:
+
+    struct Site {
+        size_t size;
+        size_t blocks;
+        std::string callstack;
+    };
+
+private:
+
+    std::vector<Site> _sites;
+    size_t _size = 0;
+    size_t _blocks = 0;
+
+    void _enter() const;
+
+    void _exit() const;
+
+public:
+
+    inline HeapDiff() { }
+
+    inline HeapDiff(const HeapDiff &rhs) {
+        _enter();
+        _sites = rhs._sites;
+        _size = rhs._size;
+        _blocks = rhs._blocks;
+        _exit();
+    }
+
+    inline HeapDiff(HeapDiff &&rhs) {
+        _enter();
+        _sites = std::move(rhs._sites);
+        _size = rhs._size;
+        _blocks = rhs._blocks;
+        _exit();
+    }
+
+    inline ~HeapDiff() {
+        _enter();
+        std::vector<Site>().swap(_sites);
+        _exit();
+    }
+
+    inline HeapDiff & operator=(const HeapDiff &rhs) {
+        _enter();
+        if (this != &rhs) {
+            _sites = rhs._sites;
+            _size = rhs._size;
+            _blocks = rhs._blocks;
+        }
+        _exit();
+        return *this;
+    }
+
+    inline HeapDiff & operator=(HeapDiff &&rhs) {
+        _enter();
+        if (this != &rhs) {
+            _sites = std::move(rhs._sites);
+            _size = rhs._size;
+            _blocks = rhs._blocks;
+        }
+        _exit();
+        return *this;
+    }
+
+    inline size_t size() const {
+        return _size;
+    }
+
+    inline size_t blocks() const {
+        return _blocks;
+    }
+
+    inline bool empty() const {
+        return _blocks == 0;
+    }
+
+    // sorted by size, largest first
+    inline const std::vector<Site> & sites() const {
+        return _sites;
+    }
+
+    std::string toString() const;
+};
+
+}  // end namespace dtest
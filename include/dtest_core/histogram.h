@@ -0,0 +1,66 @@
+/*
+ * Copyright (c) 2021 Noah Orensa.
+ * Licensed under the MIT license. See LICENSE file in the project root for details.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <cstring>
+#include <string>
+
+namespace dtest {
+
+class Log2Histogram {
+public:
+
+    // bucket 0 holds zero, bucket i holds values in [2^(i-1), 2^i)
+    static const size_t BUCKETS = 65;
+
+private:
+
+    uint64_t _counts[BUCKETS];
+    uint64_t _total = 0;
+
+public:
+
+    inline Log2Histogram() {
+        clear();
+    }
+
+    static inline size_t bucket(uint64_t value) {
+        return (value == 0) ? 0 : 64 - __builtin_clzll(value);
+    }
+
+    static inline uint64_t lowerBound(size_t bucket) {
+        return (bucket == 0) ? 0 : 1lu << (bucket - 1);
+    }
+
+    inline void add(uint64_t value) {
+        ++_counts[bucket(value)];
+        ++_total;
+    }
+
+    inline void clear() {
+        memset(_counts, 0, sizeof(_counts));
+        _total = 0;
+    }
+
+    inline uint64_t count() const {
+        return _total;
+    }
+
+    inline uint64_t count(size_t bucket) const {
+        return _counts[bucket];
+    }
+
+    // lower bound of the bucket holding the given fraction of all values
+    uint64_t percentile(double p) const;
+
+    // number of non-empty buckets
+    size_t spread() const;
+
+    std::string toString() const;
+};
+
+}  // end namespace dtest
@@ -0,0 +1,110 @@
+/*
+ * Copyright (c) 2021 Noah Orensa.
+ * Licensed under the MIT license. See LICENSE file in the project root for details.
+*/
+
+#pragma once
+
+#include <map>
+#include <iterator>
+#include <algorithm>
+#include <cstddef>
+
+namespace dtest {
+
+// disjoint address intervals ordered by start address. Removing a range trims
+// or splits the intervals it overlaps in place, so that each removal costs a
+// single O(log n) lookup plus O(1) per overlapped interval.
+template <typename T>
+class IntervalMap {
+private:
+
+    struct Start {
+        // intervals are disjoint, so trimming the head of an interval never
+        // changes its position in the map
+        mutable char *address;
+
+        inline bool operator<(const Start &other) const {
+            return address < other.address;
+        }
+    };
+
+    struct Interval {
+        size_t size;
+        T value;
+    };
+
+    std::map<Start, Interval> _intervals;
+
+public:
+
+    inline size_t size() const {
+        return _intervals.size();
+    }
+
+    inline void insert(char *start, size_t size, const T &value) {
+        _intervals.insert({ Start { start }, Interval { size, value } });
+    }
+
+    // removes [start, start + size), calling onRemove(value, bytes) for each
+    // overlapped interval. Stops at the first byte not covered by an interval,
+    // and returns the number of bytes left unmatched.
+    template <typename F>
+    size_t remove(char *start, size_t size, F onRemove) {
+        auto it = _intervals.upper_bound(Start { start });
+        if (it == _intervals.begin()) return size;
+        --it;
+
+        while (size > 0 && it != _intervals.end()) {
+            char *p = it->first.address;
+            auto &interval = it->second;
+
+            if (p > start || p + interval.size <= start) break;
+
+            size_t off = start - p;
+            size_t len = std::min(size, interval.size - off);
+            size_t rem = interval.size - off - len;
+
+            onRemove(interval.value, len);
+
+            if (off == 0 && rem == 0) {
+                it = _intervals.erase(it);
+            }
+            else if (off == 0) {
+                it->first.address += len;
+                interval.size = rem;
+            }
+            else if (rem == 0) {
+                interval.size = off;
+                ++it;
+            }
+            else {
+                interval.size = off;
+                _intervals.emplace_hint(
+                    std::next(it),
+                    Start { start + len },
+                    Interval { rem, interval.value }
+                );
+            }
+
+            start += len;
+            size -= len;
+        }
+
+        return size;
+    }
+
+    // calls f(start, size, value) for each interval, in address order
+    template <typename F>
+    void forEach(F f) {
+        for (auto &interval : _intervals) {
+            f(interval.first.address, interval.second.size, interval.second.value);
+        }
+    }
+
+    inline void clear() {
+        _intervals.clear();
+    }
+};
+
+}  // end namespace dtest
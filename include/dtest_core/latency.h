@@ -0,0 +1,106 @@
+/*
+ * Copyright (c) 2021 Noah Orensa.
+ * Licensed under the MIT license. See LICENSE file in the project root for details.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <vector>
+#include <string>
+#include <cstddef>
+#include <stdint.h>
+
+namespace dtest {
+
+// histogram of latencies in nanoseconds, with log-linear buckets in the style
+// of HdrHistogram: values below 128 ns are counted exactly, and larger ones in
+// 64 buckets per power of 2, i.e. within 1.6% of their value. Recording is a
+// few relaxed atomic operations, and can be done from any thread.
+class LatencyHistogram {
+public:
+
+    static const size_t BUCKETS = 128 + 57 * 64;
+
+private:
+
+    std::atomic<uint64_t> _counts[BUCKETS];
+    std::atomic<uint64_t> _total;
+    std::atomic<uint64_t> _sum;
+    std::atomic<uint64_t> _min;
+    std::atomic<uint64_t> _max;
+
+    static size_t _bucket(uint64_t nanos);
+
+public:
+
+    LatencyHistogram();
+
+    LatencyHistogram(const LatencyHistogram &) = delete;
+
+    LatencyHistogram & operator=(const LatencyHistogram &) = delete;
+
+    // lowest and highest values counted in a bucket
+    static uint64_t lowest(size_t bucket);
+
+    static uint64_t highest(size_t bucket);
+
+    void record(uint64_t nanos);
+
+    void reset();
+
+    inline uint64_t count() const {
+        return _total.load(std::memory_order_relaxed);
+    }
+
+    inline uint64_t min() const {
+        return count() > 0 ? _min.load(std::memory_order_relaxed) : 0;
+    }
+
+    inline uint64_t max() const {
+        return _max.load(std::memory_order_relaxed);
+    }
+
+    inline double mean() const {
+        return count() > 0 ? (double) _sum.load(std::memory_order_relaxed) / count() : 0;
+    }
+
+    // highest value equivalent to the given fraction of all values (0 - 1)
+    uint64_t percentile(double p) const;
+
+    // non-empty buckets, e.g. to be sent in a message
+    void save(std::vector<uint32_t> &buckets, std::vector<uint64_t> &counts, uint64_t &sum, uint64_t &min, uint64_t &max) const;
+
+    void load(const std::vector<uint32_t> &buckets, const std::vector<uint64_t> &counts, uint64_t sum, uint64_t min, uint64_t max);
+
+    std::string report() const;
+};
+
+// records the time from its construction until its destruction
+class LatencyTimer {
+private:
+
+    uint64_t _start;
+    bool _entered = false;
+
+public:
+
+    LatencyTimer();
+
+    LatencyTimer(const LatencyTimer &) = delete;
+
+    LatencyTimer & operator=(const LatencyTimer &) = delete;
+
+    ~LatencyTimer();
+
+    // true only on the first call, so that a timer can scope a for statement
+    inline bool once() {
+        if (_entered) return false;
+        _entered = true;
+        return true;
+    }
+};
+
+void recordLatency(uint64_t nanos);
+
+}  // end namespace dtest
@@ -0,0 +1,285 @@
+/*
+ * Copyright (c) 2021 Noah Orensa.
+ * Licensed under the MIT license. See LICENSE file in the project root for details.
+*/
+
+#pragma once
+
+#include <dtest_core/unit_test.h>
+#include <algorithm>
+
+namespace dtest {
+
+// distribution of the times between requests of a load test
+enum class Arrivals {
+    POISSON,        // exponentially distributed inter-arrival times
+    CONSTANT,       // evenly spaced requests
+};
+
+// open-loop load test. The body is one request, sent at scheduled times by
+// generator threads at a fixed total rate, regardless of how long previous
+// requests took. Latencies are measured from the scheduled send time, so that
+// queueing delay is not hidden by a generator that falls behind (coordinated
+// omission).
+class LoadTest : public UnitTest {
+
+protected:
+
+    std::vector<double> _rates = { 1000 };
+
+    Arrivals _arrivals = Arrivals::POISSON;
+
+    size_t _generators = 1;
+
+    uint64_t _duration = 1e9;               // 1 s, per rate
+
+    double _minSaturationRate = 0;
+
+    // a rate is saturated if the requests sent during the run take longer
+    // than 1 / _SATURATION of its duration to complete
+    static constexpr double _SATURATION = 0.9;
+
+    struct RateResult {
+        double offered;
+        double achieved;
+        uint64_t requests;
+        uint64_t elapsed;
+        double mean;
+        uint64_t p50;
+        uint64_t p90;
+        uint64_t p99;
+        uint64_t p999;
+        uint64_t max;
+    };
+
+    std::vector<RateResult> _results;
+
+    // runs one generator, sending requests at the given rate from start +
+    // offset until the end of the run, and returns the time of its last
+    // completion
+    uint64_t _generate(double rate, uint64_t start, uint64_t end, double offset);
+
+    // lowest offered rate that saturated, or 0 if none
+    double _saturationRate() const;
+
+    void _runBody() override;
+
+    void _sendBodyResults(Message &m) override;
+
+    void _recvBodyResults(Message &m) override;
+
+    void _driverRun() override;
+
+    std::string _loadReport();
+
+    void _report(bool driver, std::stringstream &s) override;
+
+public:
+
+    inline LoadTest(
+        const std::string &name
+    ): UnitTest(name)
+    { }
+
+    inline LoadTest(
+        const std::string &module,
+        const std::string &name
+    ): UnitTest(module, name)
+    { }
+
+    LoadTest * copy() const override {
+        return new LoadTest(*this);
+    }
+
+    ~LoadTest() = default;
+
+    inline LoadTest & dependsOn(const std::string &dependency) {
+        UnitTest::dependsOn(dependency);
+        return *this;
+    }
+
+    inline LoadTest & dependsOn(const std::initializer_list<std::string> &dependencies) {
+        UnitTest::dependsOn(dependencies);
+        return *this;
+    }
+
+    inline LoadTest & onInit(const std::function<void()> &onInit) {
+        UnitTest::onInit(onInit);
+        return *this;
+    }
+
+    inline LoadTest & body(const std::function<void()> &body) {
+        UnitTest::body(body);
+        return *this;
+    }
+
+    inline LoadTest & onComplete(const std::function<void()> &onComplete) {
+        UnitTest::onComplete(onComplete);
+        return *this;
+    }
+
+    inline LoadTest & timeoutNanos(uint64_t nanos) {
+        UnitTest::timeoutNanos(nanos);
+        return *this;
+    }
+
+    inline LoadTest & timeoutMicros(uint64_t micros) {
+        UnitTest::timeoutMicros(micros);
+        return *this;
+    }
+
+    inline LoadTest & timeoutMillis(uint64_t millis) {
+        UnitTest::timeoutMillis(millis);
+        return *this;
+    }
+
+    inline LoadTest & timeout(uint64_t seconds) {
+        UnitTest::timeout(seconds);
+        return *this;
+    }
+
+    inline LoadTest & rate(double requestsPerSecond) {
+        _rates = { requestsPerSecond };
+        return *this;
+    }
+
+    inline LoadTest & rates(const std::initializer_list<double> &requestsPerSecond) {
+        _rates = requestsPerSecond;
+        std::sort(_rates.begin(), _rates.end());
+        return *this;
+    }
+
+    inline LoadTest & arrivals(Arrivals arrivals) {
+        _arrivals = arrivals;
+        return *this;
+    }
+
+    inline LoadTest & generators(size_t n) {
+        _generators = n > 0 ? n : 1;
+        return *this;
+    }
+
+    inline LoadTest & durationNanos(uint64_t nanos) {
+        _duration = nanos;
+        return *this;
+    }
+
+    inline LoadTest & durationMicros(uint64_t micros) {
+        return durationNanos(micros * 1000lu);
+    }
+
+    inline LoadTest & durationMillis(uint64_t millis) {
+        return durationNanos(millis * 1000000lu);
+    }
+
+    inline LoadTest & duration(uint64_t seconds) {
+        return durationNanos(seconds * 1000000000lu);
+    }
+
+    inline LoadTest & minSaturationRate(double requestsPerSecond) {
+        _minSaturationRate = requestsPerSecond;
+        return *this;
+    }
+
+    inline LoadTest & expect(Status status) {
+        UnitTest::expect(status);
+        return *this;
+    }
+
+    inline LoadTest & memoryBytesLimit(size_t bytes) {
+        UnitTest::memoryBytesLimit(bytes);
+        return *this;
+    }
+
+    inline LoadTest & memoryBlocksLimit(size_t blocks) {
+        UnitTest::memoryBlocksLimit(blocks);
+        return *this;
+    }
+
+    inline LoadTest & heapProfile(size_t topN = 10) {
+        UnitTest::heapProfile(topN);
+        return *this;
+    }
+
+    inline LoadTest & heapProfileExport(const std::string &prefix) {
+        UnitTest::heapProfileExport(prefix);
+        return *this;
+    }
+
+    inline LoadTest & memoryTimeline(size_t topN = 5) {
+        UnitTest::memoryTimeline(topN);
+        return *this;
+    }
+
+    inline LoadTest & allocationHistograms(size_t topN = 5) {
+        UnitTest::allocationHistograms(topN);
+        return *this;
+    }
+
+    inline LoadTest & allocatorOverhead(bool val = true) {
+        UnitTest::allocatorOverhead(val);
+        return *this;
+    }
+
+    inline LoadTest & crossThreadFrees(size_t topN = 5) {
+        UnitTest::crossThreadFrees(topN);
+        return *this;
+    }
+
+    inline LoadTest & stackProfile(bool val = true) {
+        UnitTest::stackProfile(val);
+        return *this;
+    }
+
+    inline LoadTest & stackBytesLimit(size_t bytes) {
+        UnitTest::stackBytesLimit(bytes);
+        return *this;
+    }
+
+    inline LoadTest & workingSet(bool val = true) {
+        UnitTest::workingSet(val);
+        return *this;
+    }
+
+    inline LoadTest & counters(bool val = true) {
+        UnitTest::counters(val);
+        return *this;
+    }
+
+    inline LoadTest & allocator(Allocator allocator) {
+        UnitTest::allocator(allocator);
+        return *this;
+    }
+
+    inline LoadTest & disable() {
+        UnitTest::disable();
+        return *this;
+    }
+
+    inline LoadTest & enable() {
+        UnitTest::enable();
+        return *this;
+    }
+
+    inline LoadTest & ignoreMemoryLeak(bool val = true) {
+        UnitTest::ignoreMemoryLeak(val);
+        return *this;
+    }
+
+    inline LoadTest & inProcess(bool val = true) {
+        UnitTest::inProcess(val);
+        return *this;
+    }
+
+    inline LoadTest & input(const std::string &input) {
+        UnitTest::input(input);
+        return *this;
+    }
+
+    inline LoadTest & resourceSnapshotBodyOnly(bool val = true) {
+        UnitTest::resourceSnapshotBodyOnly(val);
+        return *this;
+    }
+};
+
+}  // end namespace dtest
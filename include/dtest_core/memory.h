@@ -6,29 +6,133 @@
 #pragma once
 
 #include <dtest_core/call_stack.h>
+#include <dtest_core/histogram.h>
+#include <dtest_core/interval_map.h>
+#include <dtest_core/heap_diff.h>
 #include <mutex>
+#include <atomic>
 #include <map>
 #include <unordered_map>
 #include <string>
+#include <vector>
+#include <ostream>
+#include <chrono>
 #include <dlfcn.h>
 
 namespace dtest {
 
+// limits the allocations made by the current thread while in scope; nested
+// budgets are all charged for each allocation
+class AllocationBudget {
+
+    friend class Memory;
+
+private:
+    size_t _maxBlocks;
+    size_t _maxBytes;
+    size_t _blocks = 0;
+    size_t _bytes = 0;
+    AllocationBudget *_parent;
+    bool _entered = false;
+
+public:
+
+    AllocationBudget(size_t maxBlocks, size_t maxBytes);
+
+    AllocationBudget(const AllocationBudget &) = delete;
+
+    AllocationBudget & operator=(const AllocationBudget &) = delete;
+
+    ~AllocationBudget();
+
+    // true only on the first call, so that a budget can scope a for statement
+    inline bool once() {
+        if (_entered) return false;
+        _entered = true;
+        return true;
+    }
+};
+
 class Memory {
 
+    friend class AllocationBudget;
+
     friend class Sandbox;
 
+public:
+
+    // optional parts of the profile, which add to the cost of every tracked
+    // allocation and are only recorded when reported
+    struct ProfileOptions {
+        bool timeline;
+        bool histograms;
+        bool overhead;
+        bool crossThreadFrees;
+    };
+
 private:
     std::mutex _mtx;
 
+    ProfileOptions _profile = ProfileOptions();
+
+    struct Site {
+        const CallStack *callstack = nullptr;
+        size_t size = 0;
+        size_t count = 0;
+        size_t totalSize = 0;
+        size_t totalCount = 0;
+
+        // last modification, and live size at the last peak if modified since
+        uint64_t stamp = 0;
+        size_t peakSize = 0;
+        size_t peakCount = 0;
+
+        // requested sizes, and lifetimes of freed blocks in nanoseconds and in
+        // allocations made in between
+        Log2Histogram sizes;
+        Log2Histogram lifetimes;
+        Log2Histogram lifetimeAllocations;
+
+        // blocks freed by a thread other than the allocating one
+        size_t crossThreadSize = 0;
+        size_t crossThreadCount = 0;
+    };
+
+    struct Sample {
+        uint64_t time;
+        size_t size;
+        size_t count;
+    };
+
     struct Allocation {
         size_t size;
-        CallStack callstack;
+        Site *site;
+        uint64_t time;
+        uint64_t index;
+        uint32_t thread;
+    };
+
+    struct Mapping {
+        Site *site;
+        uint64_t index;
+    };
+
+    // blocks of a user-managed pool or arena, reported through annotations
+    struct Pool {
+        std::string name;
+        std::unordered_map<void *, Allocation> blocks;
+        size_t size = 0;
+        size_t count = 0;
+        size_t totalSize = 0;
+        size_t totalCount = 0;
+        size_t maxSize = 0;
     };
 
     volatile bool _track = false;
+    std::unordered_map<CallStack, Site> _sites;
     std::unordered_map<void *, Allocation> _blocks;
-    std::map<char *, Allocation> _orderedBlocks;
+    IntervalMap<Mapping> _mappedBlocks;
+    std::unordered_map<const void *, Pool> _pools;
 
     size_t _allocateSize = 0;
     size_t _freeSize = 0;
@@ -36,8 +140,77 @@ private:
     size_t _freeCount = 0;
     size_t _maxAllocate = 0;
     size_t _maxAllocateCount = 0;
+    uint64_t _allocationIndex = 0;
+
+    // pooled blocks are carved from memory that is already tracked, so they
+    // are counted apart from the totals above
+    size_t _poolAllocateSize = 0;
+    size_t _poolFreeSize = 0;
+    size_t _poolAllocateCount = 0;
+    size_t _poolFreeCount = 0;
+
+    size_t _bytesLimit = (size_t) -1;
+    size_t _blocksLimit = (size_t) -1;
+
+    // histograms
+    static const size_t _POOL_MIN_FREES = 100;
+    static const uint64_t _POOL_MAX_LIFETIME = 16;     // allocations
+
+    Log2Histogram _sizes;
+    Log2Histogram _lifetimes;
+    Log2Histogram _lifetimeAllocations;
+
+    // allocator overhead, per log2 class of requested sizes
+    struct SizeClass {
+        size_t count;
+        size_t requested;
+        size_t usable;
+    };
+
+    SizeClass _sizeClasses[Log2Histogram::BUCKETS];
+
+    // resident and live bytes when the profile was reset, and the peak
+    // resident size when it was stopped
+    size_t _baselineResident = 0;
+    size_t _baselineLive = 0;
+    size_t _peakResident = 0;
+
+    // frees per (allocating thread, freeing thread) pair, keyed by
+    // allocating << 32 | freeing. Threads are numbered in the order of their
+    // first allocation.
+    struct ThreadPair {
+        size_t size;
+        size_t count;
+    };
+
+    std::unordered_map<uint64_t, ThreadPair> _threadPairs;
+    std::atomic<uint32_t> _threads { 0 };
+
+    static thread_local uint32_t _thread;
+
+    inline uint32_t _threadIndex() {
+        if (_thread == 0) _thread = ++_threads;
+        return _thread;
+    }
+
+    // timeline
+    static const size_t _TIMELINE_LENGTH = 128;
+    static const uint64_t _TIMELINE_INTERVAL = 1000;    // 1 us
+
+    bool _recordTimeline = false;
+    std::chrono::steady_clock::time_point _startTime;
+    uint64_t _timelineInterval = _TIMELINE_INTERVAL;
+    size_t _timelineLength = 0;
+    Sample _timeline[_TIMELINE_LENGTH];
+    Sample _currentSample = { 0, 0, 0 };
+
+    uint64_t _stamp = 0;
+    uint64_t _peakStamp = 0;
+    uint64_t _peakTime = 0;
+    size_t _peakCount = 0;
 
     static thread_local size_t _locked;
+    static thread_local AllocationBudget *_budget;
 
     inline bool _enter() {
         if (! _track || _locked) return false;
@@ -49,14 +222,75 @@ private:
         --_locked;
     }
 
-    bool _canTrackAlloc(const CallStack &callstack);
+    // captures the call stack of an allocation, unless it is suppressed. The
+    // frames needed by the suppressions are checked before the full trace.
+    __attribute__((noinline)) bool _traceAlloc(CallStack &callstack, int skip);
 
     bool _canTrackDealloc(const CallStack &callstack);
 
+    Site * _site(CallStack &&callstack);
+
+    inline void _touch(Site *site) {
+        if (site->stamp < _peakStamp) {
+            site->peakSize = site->size;
+            site->peakCount = site->count;
+        }
+        site->stamp = ++_stamp;
+    }
+
+    static inline uint64_t _now() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()
+        ).count();
+    }
+
+    Allocation _acquire(Site *site, size_t size, bool pooled = false);
+
+    void _release(const Allocation &alloc, bool pooled = false);
+
+    static std::string _poolName(const void *pool, const Pool &p);
+
+    void _updateUsage();
+
+    inline bool _withinLimits() const {
+        return _allocateSize - _freeSize <= _bytesLimit
+            && _allocateCount - _freeCount <= _blocksLimit;
+    }
+
+    [[noreturn]] void _limitExceeded();
+
+    // charges all budgets in scope, returning the innermost exceeded one
+    inline AllocationBudget * _charge(size_t bytes) {
+        AllocationBudget *exceeded = nullptr;
+
+        for (auto budget = _budget; budget != nullptr; budget = budget->_parent) {
+            ++budget->_blocks;
+            budget->_bytes += bytes;
+
+            if (
+                exceeded == nullptr
+                && (budget->_blocks > budget->_maxBlocks || budget->_bytes > budget->_maxBytes)
+            ) exceeded = budget;
+        }
+
+        return exceeded;
+    }
+
+    [[noreturn]] void _budgetExceeded(const AllocationBudget *budget);
+
+    void _pushSample();
+
+    // untracks a mapped range, returning the number of bytes that were not mapped
+    size_t _unmap(char *ptr, size_t size);
+
+    std::vector<const Site *> _sortedSites(bool liveOnly);
+
 public:
 
     static void reinitialize(void *handle = RTLD_DEFAULT);
 
+    static bool loadSuppressions(const std::string &path, std::string &error);
+
     Memory();
 
     inline void trackActivity(bool val) {
@@ -71,6 +305,18 @@ public:
         --_locked;
     }
 
+    inline void limits(size_t bytes, size_t blocks) {
+        _bytesLimit = bytes;
+        _blocksLimit = blocks;
+    }
+
+    // the timeline starts at the next resetProfile(); the other options take
+    // effect immediately, and blocks allocated while they were off carry no
+    // time or thread
+    inline void profileOptions(const ProfileOptions &options) {
+        _profile = options;
+    }
+
     void track(void *ptr, size_t size);
 
     void track_mapped(char *ptr, size_t size);
@@ -83,13 +329,47 @@ public:
 
     void remove_mapped(char *ptr, size_t size);
 
+    void track_pooled(const void *pool, void *ptr, size_t size);
+
+    void remove_pooled(const void *pool, void *ptr);
+
+    void reset_pool(const void *pool);
+
+    void name_pool(const void *pool, const char *name);
+
     void clear();
 
+    inline size_t allocationCount() const {
+        return _allocateCount;
+    }
+
     void resetMaxAllocation() {
         _maxAllocate = 0;
     }
 
+    void resetProfile();
+
+    void stopTimeline();
+
     std::string report();
+
+    std::string profile(size_t topN);
+
+    void exportProfile(std::ostream &out, bool live);
+
+    std::string timeline(size_t topN);
+
+    std::string histograms(size_t topN);
+
+    std::string pools();
+
+    std::string overhead();
+
+    std::string crossThreadFrees(size_t topN);
+
+    HeapSnapshot heapSnapshot();
+
+    void heapDiff(const HeapSnapshot &from, const HeapSnapshot &to, HeapDiff &diff);
 };
 
 }  // end namespace dtest
@@ -6,21 +6,235 @@
 #pragma once
 
 #include <dtest_core/unit_test.h>
+#include <dtest_core/statistics.h>
+#include <algorithm>
 
 namespace dtest {
 
+// test used to decide whether the body is faster than the baseline, when both
+// are run more than once
+enum class Significance {
+    MANN_WHITNEY,   // one-sided Mann-Whitney U test on the run times
+    BOOTSTRAP,      // bootstrap upper bound of the ratio of mean run times
+};
+
+// quantity compared between the body and the baseline
+enum class Metric {
+    TIME,           // wall-clock time of each run
+    INSTRUCTIONS,   // retired instructions, or CPU time without a PMU
+};
+
+// order in which body and baseline runs alternate in the same sandbox
+enum class Interleave {
+    NONE,           // all body runs, then all baseline runs in another sandbox
+    ALTERNATE,      // body, baseline, body, baseline, ...
+    RANDOM,         // each pair in a random order
+};
+
 class PerformanceTest : public UnitTest {
 
 protected:
 
     std::function<void()> _baseline;
 
+    // microbenchmark bodies, called with the number of iterations to run
+    std::function<void(uint64_t)> _microBody;
+    std::function<void(uint64_t)> _microBaseline;
+
+    // batch size and timer/loop overhead of a microbenchmark side
+    struct Batch {
+        uint64_t size = 1;
+        uint64_t overhead = 0;
+    };
+
+    Batch _bodyBatch;
+    Batch _baselineBatch;
+
+    // counter totals of the measured runs of a side, and the number of
+    // iterations they cover. With the instructions metric, work holds the
+    // instructions per iteration of each measured run.
+    struct PhaseCounters {
+        CounterValues values;
+        uint64_t iterations = 0;
+        std::vector<double> work;
+    };
+
+    PhaseCounters _bodyCounters;
+    PhaseCounters _baselineCounters;
+
+    uint64_t _microTarget = 1e6;            // 1 ms
+
+    // alternative implementations, measured round-robin in the body sandbox
+    struct Variant {
+        std::string name;
+        std::function<void()> func;
+        std::function<void(uint64_t)> micro;
+
+        Batch batch;
+        std::vector<double> samples;
+        size_t allocations = 0;
+
+        // speedup over the slowest variant, with its confidence interval
+        double speedup = 0;
+        double speedupLow = 0;
+        double speedupHigh = 0;
+    };
+
+    std::vector<Variant> _variants;
+
+    // requires variant faster to be at least factor times faster than slower
+    struct Speedup {
+        std::string faster;
+        std::string slower;
+        double factor;
+    };
+
+    std::vector<Speedup> _expectedSpeedups;
+
+    // input sizes swept by parameterized tests, in increasing order
+    std::vector<uint64_t> _params;
+
+    std::function<void(uint64_t)> _paramInit;
+    std::function<void(uint64_t)> _paramBody;
+    std::function<void(uint64_t)> _paramBaseline;
+
+    // median time at each input size
+    std::vector<double> _bodyParamTimes;
+    std::vector<double> _baselineParamTimes;
+
+    ComplexityFit _bodyFit;
+    ComplexityFit _baselineFit;
+
+    bool _complexityExpected = false;
+    Complexity _expectedComplexity = Complexity::O_1;
+
+    // latency distribution of the body, recorded per run or per operation
+    bool _latency = false;
+
+    struct LatencyLimit {
+        double percentile;      // 0 - 100, as in percentileBelow
+        uint64_t nanos;
+    };
+
+    std::vector<LatencyLimit> _latencyLimits;
+
+    // non-empty buckets of the latency histogram, sent from the body sandbox
+    std::vector<uint32_t> _latencyBuckets;
+    std::vector<uint64_t> _latencyCounts;
+    uint64_t _latencySum = 0;
+    uint64_t _latencyMin = 0;
+    uint64_t _latencyMax = 0;
+
     uint64_t _baselineTime = 0;
 
-    uint64_t _performanceMargin = 1e6;      // 1 ms
+    std::vector<double> _baselineSamples;
+
+    size_t _baselineAllocations = 0;
+
+    size_t _maxAllocationsPerBody = (size_t) -1;
+
+    // 1 ms by default, or none if either side is a microbenchmark
+    uint64_t _performanceMargin = (uint64_t) -1;
 
     double _performanceMarginRatio = 0;
 
+    size_t _repetitions = 1;
+
+    size_t _warmup = 0;
+
+    uint64_t _minTime = 0;
+
+    Significance _significance = Significance::MANN_WHITNEY;
+
+    double _alpha = 0.05;
+
+    Interleave _interleave = Interleave::NONE;
+
+    Metric _metric = Metric::TIME;
+
+    bool _flushCaches = false;
+
+    char *_flushBuffer = nullptr;
+
+    // p-value of the Mann-Whitney U test, or upper bound of the body/baseline
+    // ratio for the bootstrap test. Negative if no test was run.
+    double _significanceResult = -1;
+
+    uint64_t _margin() const;
+
+    // runs func (or micro, in batches) for the configured warm-up and
+    // measured runs. Samples are per-iteration times for microbenchmarks.
+    // Sets time to the median sample and allocations to those of the first
+    // measured run.
+    void _measure(
+        const std::function<void()> &func,
+        const std::function<void(uint64_t)> &micro,
+        uint64_t &time,
+        size_t &allocations,
+        std::vector<double> &samples,
+        Batch &batch,
+        PhaseCounters &counters
+    );
+
+    // interleaving does not apply to parameterized tests
+    inline bool _interleaved() const {
+        return _interleave != Interleave::NONE && _params.empty();
+    }
+
+    void _calibrate(const std::function<void(uint64_t)> &micro, Batch &batch);
+
+    // times a run of func, or a batch of micro, returning the time per
+    // iteration. The counts of the run are added to counters, if the
+    // counters are open.
+    double _timeRun(
+        const std::function<void()> &func,
+        const std::function<void(uint64_t)> &micro,
+        const Batch &batch,
+        size_t *allocations = nullptr,
+        PhaseCounters *counters = nullptr
+    );
+
+    // evicts the caches and the TLB
+    void _flush();
+
+    void _releaseFlushBuffer();
+
+    // alternates body and baseline runs, filling both sets of samples
+    void _measureInterleaved();
+
+    // measures func at each input size, leaving the samples, time and
+    // allocations of the largest one
+    void _measureParams(
+        const std::function<void(uint64_t)> &func,
+        std::vector<double> &times,
+        uint64_t &time,
+        size_t &allocations,
+        std::vector<double> &samples,
+        Batch &batch,
+        PhaseCounters &counters
+    );
+
+    // fits the body times to a complexity class, and checks the expected one
+    void _checkComplexity();
+
+    std::string _paramReport();
+
+    void _checkLatency();
+
+    // runs each variant once per round, rotating their order between rounds
+    void _measureVariants();
+
+    // ranks the variants and checks the expected speedups
+    void _checkVariants();
+
+    std::string _variantReport();
+
+    void _runBody() override;
+
+    void _sendBodyResults(Message &m) override;
+
+    void _recvBodyResults(Message &m) override;
+
     void _checkPerformance();
 
     void _driverRun() override;
@@ -61,16 +275,115 @@ public:
         return *this;
     }
 
+    inline PerformanceTest & onInit(const std::function<void(uint64_t)> &onInit) {
+        _paramInit = onInit;
+        return *this;
+    }
+
     inline PerformanceTest & body(const std::function<void()> &body) {
         UnitTest::body(body);
         return *this;
     }
 
+    inline PerformanceTest & body(const std::function<void(uint64_t)> &body) {
+        _paramBody = body;
+        return *this;
+    }
+
     inline PerformanceTest & baseline(const std::function<void()> &baseline) {
         _baseline = baseline;
         return *this;
     }
 
+    inline PerformanceTest & baseline(const std::function<void(uint64_t)> &baseline) {
+        _paramBaseline = baseline;
+        return *this;
+    }
+
+    inline PerformanceTest & params(const std::initializer_list<double> &sizes) {
+        _params.clear();
+        for (auto n : sizes) _params.push_back(n);
+        std::sort(_params.begin(), _params.end());
+        return *this;
+    }
+
+    inline PerformanceTest & latency(bool val = true) {
+        _latency = val;
+        return *this;
+    }
+
+    inline PerformanceTest & percentileBelowNanos(double percentile, uint64_t nanos) {
+        _latency = true;
+        _latencyLimits.push_back({ percentile, nanos });
+        return *this;
+    }
+
+    inline PerformanceTest & percentileBelowMicros(double percentile, uint64_t micros) {
+        return percentileBelowNanos(percentile, micros * 1000lu);
+    }
+
+    inline PerformanceTest & percentileBelowMillis(double percentile, uint64_t millis) {
+        return percentileBelowNanos(percentile, millis * 1000000lu);
+    }
+
+    inline PerformanceTest & percentileBelow(double percentile, uint64_t seconds) {
+        return percentileBelowNanos(percentile, seconds * 1000000000lu);
+    }
+
+    inline PerformanceTest & expectComplexity(Complexity complexity) {
+        _complexityExpected = true;
+        _expectedComplexity = complexity;
+        return *this;
+    }
+
+    inline PerformanceTest & microBody(const std::function<void(uint64_t)> &body) {
+        _microBody = body;
+        return *this;
+    }
+
+    inline PerformanceTest & microBaseline(const std::function<void(uint64_t)> &baseline) {
+        _microBaseline = baseline;
+        return *this;
+    }
+
+    inline PerformanceTest & variant(const std::string &name, const std::function<void()> &func) {
+        Variant v;
+        v.name = name;
+        v.func = func;
+        _variants.push_back(v);
+        return *this;
+    }
+
+    inline PerformanceTest & microVariant(const std::string &name, const std::function<void(uint64_t)> &func) {
+        Variant v;
+        v.name = name;
+        v.micro = func;
+        _variants.push_back(v);
+        return *this;
+    }
+
+    inline PerformanceTest & expectFaster(
+        const std::string &faster,
+        const std::string &slower,
+        double factor = 1
+    ) {
+        _expectedSpeedups.push_back({ faster, slower, factor });
+        return *this;
+    }
+
+    inline PerformanceTest & microTargetNanos(uint64_t nanos) {
+        _microTarget = nanos;
+        return *this;
+    }
+
+    inline PerformanceTest & microTargetMicros(uint64_t micros) {
+        return microTargetNanos(micros * 1000lu);
+    }
+
+    inline PerformanceTest & microTargetMillis(uint64_t millis) {
+        return microTargetNanos(millis * 1000000lu);
+    }
+
     inline PerformanceTest & onComplete(const std::function<void()> &onComplete) {
         UnitTest::onComplete(onComplete);
         return *this;
@@ -118,6 +431,60 @@ public:
         return *this;
     }
 
+    inline PerformanceTest & maxAllocationsPerBody(size_t blocks) {
+        _maxAllocationsPerBody = blocks;
+        return *this;
+    }
+
+    inline PerformanceTest & repetitions(size_t n) {
+        _repetitions = n > 0 ? n : 1;
+        return *this;
+    }
+
+    inline PerformanceTest & warmup(size_t n) {
+        _warmup = n;
+        return *this;
+    }
+
+    inline PerformanceTest & minTimeNanos(uint64_t nanos) {
+        _minTime = nanos;
+        return *this;
+    }
+
+    inline PerformanceTest & minTimeMicros(uint64_t micros) {
+        return minTimeNanos(micros * 1000lu);
+    }
+
+    inline PerformanceTest & minTimeMillis(uint64_t millis) {
+        return minTimeNanos(millis * 1000000lu);
+    }
+
+    inline PerformanceTest & minTime(uint64_t seconds) {
+        return minTimeNanos(seconds * 1000000000lu);
+    }
+
+    inline PerformanceTest & interleave(Interleave order = Interleave::ALTERNATE) {
+        _interleave = order;
+        return *this;
+    }
+
+    inline PerformanceTest & flushCaches(bool val = true) {
+        _flushCaches = val;
+        return *this;
+    }
+
+    inline PerformanceTest & metric(Metric metric) {
+        _metric = metric;
+        if (metric == Metric::INSTRUCTIONS) _counters = true;
+        return *this;
+    }
+
+    inline PerformanceTest & significance(Significance test, double alpha = 0.05) {
+        _significance = test;
+        _alpha = alpha;
+        return *this;
+    }
+
     inline PerformanceTest & expect(Status status) {
         UnitTest::expect(status);
         return *this;
@@ -133,6 +500,61 @@ public:
         return *this;
     }
 
+    inline PerformanceTest & heapProfile(size_t topN = 10) {
+        UnitTest::heapProfile(topN);
+        return *this;
+    }
+
+    inline PerformanceTest & heapProfileExport(const std::string &prefix) {
+        UnitTest::heapProfileExport(prefix);
+        return *this;
+    }
+
+    inline PerformanceTest & memoryTimeline(size_t topN = 5) {
+        UnitTest::memoryTimeline(topN);
+        return *this;
+    }
+
+    inline PerformanceTest & allocationHistograms(size_t topN = 5) {
+        UnitTest::allocationHistograms(topN);
+        return *this;
+    }
+
+    inline PerformanceTest & allocatorOverhead(bool val = true) {
+        UnitTest::allocatorOverhead(val);
+        return *this;
+    }
+
+    inline PerformanceTest & crossThreadFrees(size_t topN = 5) {
+        UnitTest::crossThreadFrees(topN);
+        return *this;
+    }
+
+    inline PerformanceTest & stackProfile(bool val = true) {
+        UnitTest::stackProfile(val);
+        return *this;
+    }
+
+    inline PerformanceTest & stackBytesLimit(size_t bytes) {
+        UnitTest::stackBytesLimit(bytes);
+        return *this;
+    }
+
+    inline PerformanceTest & workingSet(bool val = true) {
+        UnitTest::workingSet(val);
+        return *this;
+    }
+
+    inline PerformanceTest & counters(bool val = true) {
+        UnitTest::counters(val);
+        return *this;
+    }
+
+    inline PerformanceTest & allocator(Allocator allocator) {
+        UnitTest::allocator(allocator);
+        return *this;
+    }
+
     inline PerformanceTest & disable() {
         UnitTest::disable();
         return *this;
@@ -11,6 +11,10 @@
 #include <dtest_core/memory.h>
 #include <sys/socket.h>
 #include <dtest_core/network.h>
+#include <dtest_core/stack.h>
+#include <dtest_core/working_set.h>
+#include <dtest_core/latency.h>
+#include <dtest_core/counters.h>
 #include <functional>
 #include <dtest_core/message.h>
 #include <dtest_core/buffer.h>
@@ -29,14 +33,29 @@ struct ResourceSnapshot {
         Quantity allocate;
         Quantity deallocate;
         Quantity max;
+
+        // blocks of annotated pools, which are not part of the totals above
+        Quantity poolAllocate;
+        Quantity poolDeallocate;
     } memory;
 
     struct {
         Quantity send;
         Quantity receive;
     } network;
+
+    CounterValues counters;
+};
+
+enum class FatalError : uint16_t {
+    NONE,
+    MEMORY_BLOCK_DOES_NOT_EXIST,
+    MEMORY_LIMIT_EXCEEDED,
+    ALLOCATION_BUDGET_EXCEEDED
 };
 
+class SandboxFatalException;
+
 class Sandbox {
 
     friend class CallStack;
@@ -49,6 +68,7 @@ private:
 
     std::mutex _mtx;
     bool _enabled = true;
+    bool _forked = false;
     size_t _counter = 1;
 
     Socket _serverSocket;
@@ -56,6 +76,10 @@ private:
 
     Memory _memory;
     Network _network;
+    Stack _stack;
+    WorkingSet _workingSet;
+    LatencyHistogram _latency;
+    Counters _counters;
 
     int _saved_stdio[3];
     int _sandboxed_stdio[3];
@@ -74,6 +98,7 @@ public:
         Buffer _in;
         Buffer _out;
         Buffer _err;
+        FatalError _fatalError = FatalError::NONE;
 
     public:
 
@@ -98,6 +123,10 @@ public:
         Buffer & error() {
             return _err;
         }
+
+        FatalError fatalError() const {
+            return _fatalError;
+        }
     };
 
     inline void enable() {
@@ -118,6 +147,8 @@ public:
 
     void unlock();
 
+    [[noreturn]] void fatalError(const SandboxFatalException &e);
+
     bool run(
         uint64_t timeoutNanos,
         const std::function<void()> &func,
@@ -133,6 +164,110 @@ public:
         return _memory.report();
     }
 
+    inline std::string memoryProfile(size_t topN) {
+        return _memory.profile(topN);
+    }
+
+    inline std::string memoryTimeline(size_t topN) {
+        return _memory.timeline(topN);
+    }
+
+    inline std::string memoryHistograms(size_t topN) {
+        return _memory.histograms(topN);
+    }
+
+    inline std::string memoryCrossThreadFrees(size_t topN) {
+        return _memory.crossThreadFrees(topN);
+    }
+
+    inline std::string memoryOverhead() {
+        return _memory.overhead();
+    }
+
+    inline std::string memoryPools() {
+        return _memory.pools();
+    }
+
+    inline void startStackProfile() {
+        _stack.start();
+    }
+
+    inline void stopStackProfile() {
+        _stack.stop();
+    }
+
+    inline size_t maxStackUsage() const {
+        return _stack.peak();
+    }
+
+    inline std::string stackProfile() const {
+        return _stack.report();
+    }
+
+    inline void startWorkingSet() {
+        _workingSet.start();
+    }
+
+    inline void stopWorkingSet() {
+        _workingSet.stop();
+    }
+
+    inline std::string workingSet() const {
+        return _workingSet.report();
+    }
+
+    inline void recordLatency(uint64_t nanos) {
+        _latency.record(nanos);
+    }
+
+    inline void resetLatency() {
+        _latency.reset();
+    }
+
+    inline const LatencyHistogram & latency() const {
+        return _latency;
+    }
+
+    inline void openCounters() {
+        _counters.open();
+    }
+
+    inline void closeCounters() {
+        _counters.close();
+    }
+
+    inline bool countersOpen() const {
+        return _counters.isOpen();
+    }
+
+    inline void readCounters(CounterValues &values) const {
+        _counters.read(values);
+    }
+
+    void exportMemoryProfile(const std::string &prefix);
+
+    inline HeapSnapshot heapSnapshot() {
+        return _memory.heapSnapshot();
+    }
+
+    inline HeapDiff heapDiff(const HeapSnapshot &from, const HeapSnapshot &to) {
+        HeapDiff diff;
+        _memory.heapDiff(from, to, diff);
+        return diff;
+    }
+
+    inline size_t memoryAllocationCount() const {
+        return _memory.allocationCount();
+    }
+
+    inline void memoryLimits(size_t bytes, size_t blocks) {
+        _memory.limits(bytes, blocks);
+    }
+
+    inline void memoryProfileOptions(const Memory::ProfileOptions &options) {
+        _memory.profileOptions(options);
+    }
+
     inline void clearMemoryBlocks() {
         _memory.clear();
     }
@@ -164,6 +299,7 @@ struct LibC {
     void * (*realloc)(void *, size_t) = nullptr;
     void * (*reallocarray)(void *, size_t, size_t) = nullptr;
     void (*free)(void *) = nullptr;
+    size_t (*malloc_usable_size)(void *) = nullptr;
 
     void * (*mmap)(void *, size_t, int, int, int, __off_t) = nullptr;
     void * (*mremap)(void *, size_t, size_t, int, ...) = nullptr;
@@ -173,6 +309,8 @@ struct LibC {
     ssize_t (*sendto)(int, const void *, size_t, int, const struct sockaddr *, socklen_t) = nullptr;
     ssize_t (*recv)(int, void *, size_t, int) = nullptr;
     ssize_t (*recvfrom)(int, void * __restrict, size_t, int, struct sockaddr * __restrict, socklen_t * __restrict) = nullptr;
+
+    int (*pthread_create)(pthread_t *, const pthread_attr_t *, void * (*)(void *), void *) = nullptr;
 };
 
 LibC & libc();
@@ -193,18 +331,22 @@ public:
     }
 };
 
-enum class FatalError : uint16_t {
-    MEMORY_BLOCK_DOES_NOT_EXIST
-};
-
 class SandboxFatalException : public SandboxException {
+private:
+    FatalError _code;
+
 public:
     inline SandboxFatalException(FatalError code, const std::string &msg, int stackSkip)
     : SandboxException(
         std::string("Detected fatal error: ") + msg
         + ". Caused by:\n" + CallStack::trace(1 + stackSkip).toString()
-      )
+      ),
+      _code(code)
     { }
+
+    inline FatalError code() const {
+        return _code;
+    }
 };
 
 }  // end namespace dtest
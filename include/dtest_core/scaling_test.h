@@ -0,0 +1,250 @@
+/*
+ * Copyright (c) 2021 Noah Orensa.
+ * Licensed under the MIT license. See LICENSE file in the project root for details.
+*/
+
+#pragma once
+
+#include <dtest_core/unit_test.h>
+
+namespace dtest {
+
+class ScalingTest : public UnitTest {
+
+protected:
+
+    // body run with the number of threads to use
+    std::function<void(size_t)> _scaleBody;
+
+    // explicit thread counts to sweep. By default, powers of 2 up to the
+    // number of cores (or _maxThreads), and the number of cores itself.
+    std::vector<size_t> _threadCounts;
+
+    size_t _maxThreads = 0;
+
+    size_t _repetitions = 1;
+
+    // sets the OpenMP thread count to match each run
+    bool _ompThreads = false;
+
+    struct Efficiency {
+        size_t threads;
+        double min;
+    };
+
+    std::vector<Efficiency> _minEfficiency;
+
+    // swept thread counts and median time of each
+    std::vector<size_t> _scaleThreads;
+    std::vector<double> _scaleTimes;
+    std::vector<double> _scaleSamples;
+
+    std::vector<size_t> _sweep() const;
+
+    void _runBody() override;
+
+    void _sendBodyResults(Message &m) override;
+
+    void _recvBodyResults(Message &m) override;
+
+    void _checkScaling();
+
+    void _driverRun() override;
+
+    std::string _scalingReport();
+
+    void _report(bool driver, std::stringstream &s) override;
+
+public:
+
+    inline ScalingTest(
+        const std::string &name
+    ): UnitTest(name)
+    { }
+
+    inline ScalingTest(
+        const std::string &module,
+        const std::string &name
+    ): UnitTest(module, name)
+    { }
+
+    ScalingTest * copy() const override {
+        return new ScalingTest(*this);
+    }
+
+    ~ScalingTest() = default;
+
+    inline ScalingTest & dependsOn(const std::string &dependency) {
+        UnitTest::dependsOn(dependency);
+        return *this;
+    }
+
+    inline ScalingTest & dependsOn(const std::initializer_list<std::string> &dependencies) {
+        UnitTest::dependsOn(dependencies);
+        return *this;
+    }
+
+    inline ScalingTest & onInit(const std::function<void()> &onInit) {
+        UnitTest::onInit(onInit);
+        return *this;
+    }
+
+    UnitTest & body(const std::function<void()> &) = delete;
+
+    inline ScalingTest & body(const std::function<void(size_t)> &body) {
+        _scaleBody = body;
+        return *this;
+    }
+
+    inline ScalingTest & onComplete(const std::function<void()> &onComplete) {
+        UnitTest::onComplete(onComplete);
+        return *this;
+    }
+
+    inline ScalingTest & timeoutNanos(uint64_t nanos) {
+        UnitTest::timeoutNanos(nanos);
+        return *this;
+    }
+
+    inline ScalingTest & timeoutMicros(uint64_t micros) {
+        UnitTest::timeoutMicros(micros);
+        return *this;
+    }
+
+    inline ScalingTest & timeoutMillis(uint64_t millis) {
+        UnitTest::timeoutMillis(millis);
+        return *this;
+    }
+
+    inline ScalingTest & timeout(uint64_t seconds) {
+        UnitTest::timeout(seconds);
+        return *this;
+    }
+
+    inline ScalingTest & threads(const std::initializer_list<size_t> &counts) {
+        _threadCounts = counts;
+        return *this;
+    }
+
+    inline ScalingTest & maxThreads(size_t n) {
+        _maxThreads = n;
+        return *this;
+    }
+
+    inline ScalingTest & repetitions(size_t n) {
+        _repetitions = n > 0 ? n : 1;
+        return *this;
+    }
+
+    inline ScalingTest & ompThreads(bool val = true) {
+        _ompThreads = val;
+        return *this;
+    }
+
+    inline ScalingTest & minEfficiency(size_t threads, double efficiency) {
+        _minEfficiency.push_back({ threads, efficiency });
+        return *this;
+    }
+
+    inline ScalingTest & expect(Status status) {
+        UnitTest::expect(status);
+        return *this;
+    }
+
+    inline ScalingTest & memoryBytesLimit(size_t bytes) {
+        UnitTest::memoryBytesLimit(bytes);
+        return *this;
+    }
+
+    inline ScalingTest & memoryBlocksLimit(size_t blocks) {
+        UnitTest::memoryBlocksLimit(blocks);
+        return *this;
+    }
+
+    inline ScalingTest & heapProfile(size_t topN = 10) {
+        UnitTest::heapProfile(topN);
+        return *this;
+    }
+
+    inline ScalingTest & heapProfileExport(const std::string &prefix) {
+        UnitTest::heapProfileExport(prefix);
+        return *this;
+    }
+
+    inline ScalingTest & memoryTimeline(size_t topN = 5) {
+        UnitTest::memoryTimeline(topN);
+        return *this;
+    }
+
+    inline ScalingTest & allocationHistograms(size_t topN = 5) {
+        UnitTest::allocationHistograms(topN);
+        return *this;
+    }
+
+    inline ScalingTest & allocatorOverhead(bool val = true) {
+        UnitTest::allocatorOverhead(val);
+        return *this;
+    }
+
+    inline ScalingTest & crossThreadFrees(size_t topN = 5) {
+        UnitTest::crossThreadFrees(topN);
+        return *this;
+    }
+
+    inline ScalingTest & stackProfile(bool val = true) {
+        UnitTest::stackProfile(val);
+        return *this;
+    }
+
+    inline ScalingTest & stackBytesLimit(size_t bytes) {
+        UnitTest::stackBytesLimit(bytes);
+        return *this;
+    }
+
+    inline ScalingTest & workingSet(bool val = true) {
+        UnitTest::workingSet(val);
+        return *this;
+    }
+
+    inline ScalingTest & counters(bool val = true) {
+        UnitTest::counters(val);
+        return *this;
+    }
+
+    inline ScalingTest & allocator(Allocator allocator) {
+        UnitTest::allocator(allocator);
+        return *this;
+    }
+
+    inline ScalingTest & disable() {
+        UnitTest::disable();
+        return *this;
+    }
+
+    inline ScalingTest & enable() {
+        UnitTest::enable();
+        return *this;
+    }
+
+    inline ScalingTest & ignoreMemoryLeak(bool val = true) {
+        UnitTest::ignoreMemoryLeak(val);
+        return *this;
+    }
+
+    inline ScalingTest & inProcess(bool val = true) {
+        UnitTest::inProcess(val);
+        return *this;
+    }
+
+    inline ScalingTest & input(const std::string &input) {
+        UnitTest::input(input);
+        return *this;
+    }
+
+    inline ScalingTest & resourceSnapshotBodyOnly(bool val = true) {
+        UnitTest::resourceSnapshotBodyOnly(val);
+        return *this;
+    }
+};
+
+}  // end namespace dtest
@@ -0,0 +1,89 @@
+/*
+ * Copyright (c) 2021 Noah Orensa.
+ * Licensed under the MIT license. See LICENSE file in the project root for details.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <string>
+#include <cstddef>
+#include <stdint.h>
+
+namespace dtest {
+
+// measures the peak stack usage of the sandbox body thread and of the threads
+// it creates, by painting the unused part of each stack with a known pattern
+// and later scanning for the lowest overwritten word.
+class Stack {
+
+    friend class Sandbox;
+
+public:
+
+    // painted part [low, high) of a stack ending at top
+    struct Region {
+        uint64_t *low = nullptr;
+        uint64_t *high = nullptr;
+        char *top = nullptr;
+    };
+
+private:
+
+    static const uint64_t _PATTERN = 0x57ac57ac57ac57aclu;
+
+    // unused bytes left unpainted right below the stack pointer, for the
+    // frame of the painting function and the red zone
+    static const size_t _MARGIN = 4096;
+
+    // bytes left unpainted at the bottom of the main thread stack, which is
+    // grown on demand and must keep its distance from neighboring mappings
+    static const size_t _MAIN_GUARD = 1024 * 1024;
+
+    static const size_t _MAX_PAINT = 64 * 1024 * 1024;
+    static const size_t _MAX_THREADS = 64;
+
+    volatile bool _track = false;
+
+    Region _body;
+    size_t _bodyPeak = 0;
+
+    // peaks of the threads that exited while tracking, in exit order
+    std::atomic<size_t> _threads;
+    size_t _threadPeaks[_MAX_THREADS];
+
+    static void _paint(Region &region);
+
+    static size_t _scan(const Region &region);
+
+    inline size_t _reportedThreads() const {
+        size_t n = _threads;
+        return (n < _MAX_THREADS) ? n : _MAX_THREADS;
+    }
+
+public:
+
+    Stack();
+
+    inline bool tracking() const {
+        return _track;
+    }
+
+    // paints the stack of the calling thread, and of threads created from now on
+    void start();
+
+    // scans the stack of the calling thread. Threads still running are not
+    // reported.
+    void stop();
+
+    // called by threads created while tracking
+    void paintThread(Region &region);
+
+    void scanThread(const Region &region);
+
+    size_t peak() const;
+
+    std::string report() const;
+};
+
+}  // end namespace dtest
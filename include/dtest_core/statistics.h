@@ -0,0 +1,96 @@
+/*
+ * Copyright (c) 2021 Noah Orensa.
+ * Licensed under the MIT license. See LICENSE file in the project root for details.
+*/
+
+#pragma once
+
+#include <vector>
+#include <string>
+#include <functional>
+#include <utility>
+#include <stdint.h>
+
+namespace dtest {
+
+// descriptive statistics of a set of time samples, in nanoseconds
+struct Summary {
+    size_t samples = 0;
+    double mean = 0;
+    double stddev = 0;
+    double min = 0;
+    double median = 0;
+    double p90 = 0;
+    double p99 = 0;
+    double max = 0;
+
+    Summary() = default;
+
+    Summary(std::vector<double> samples);
+
+    // JSON fields of the summary, formatted as durations unless the samples
+    // are plain counts
+    std::string toString(bool durations = true) const;
+};
+
+// nearest-rank percentile of sorted samples
+double percentile(const std::vector<double> &sorted, double p);
+
+// one-sided p-value of the Mann-Whitney U test, for the hypothesis that
+// values drawn from a are smaller than values drawn from b. Uses the normal
+// approximation with tie and continuity corrections.
+double mannWhitneyU(const std::vector<double> &a, const std::vector<double> &b);
+
+// one-sided p-value of the Wilcoxon signed-rank test, for the hypothesis that
+// a[i] is smaller than its pair b[i]. Uses the normal approximation with tie
+// and continuity corrections.
+double wilcoxonSignedRank(const std::vector<double> &a, const std::vector<double> &b);
+
+// one-sided upper bound, at the given confidence, of statistic(a, b) over
+// bootstrap resamples of a and b. Paired samples are resampled together. The
+// seed is fixed, so that results are reproducible.
+double bootstrapUpperBound(
+    const std::vector<double> &a,
+    const std::vector<double> &b,
+    const std::function<double(const std::vector<double> &, const std::vector<double> &)> &statistic,
+    double confidence,
+    bool paired = false,
+    size_t resamples = 2000
+);
+
+// two-sided interval, at the given confidence, of statistic(a, b) over
+// bootstrap resamples of a and b
+std::pair<double, double> bootstrapInterval(
+    const std::vector<double> &a,
+    const std::vector<double> &b,
+    const std::function<double(const std::vector<double> &, const std::vector<double> &)> &statistic,
+    double confidence,
+    bool paired = false,
+    size_t resamples = 2000
+);
+
+double mean(const std::vector<double> &x);
+
+// complexity classes, in increasing order of growth
+enum class Complexity {
+    O_1,
+    LOG_N,
+    N,
+    N_LOG_N,
+    N_SQUARED,
+    N_CUBED,
+};
+
+std::string toString(Complexity complexity);
+
+// least-squares fit of times t(n) = coefficient * f(n), for a complexity class f
+struct ComplexityFit {
+    Complexity complexity = Complexity::O_1;
+    double coefficient = 0;
+    double rms = 0;         // root mean square error, relative to the mean time
+};
+
+// fit of the complexity class with the lowest error
+ComplexityFit fitComplexity(const std::vector<uint64_t> &n, const std::vector<double> &t);
+
+}  // end namespace dtest
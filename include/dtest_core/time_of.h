@@ -11,4 +11,20 @@
 namespace dtest
 {
     uint64_t timeOf(const std::function<void()> &func);
+
+    // forces value to be computed, without emitting any instruction
+    template <typename T>
+    inline void doNotOptimize(const T &value) {
+        asm volatile("" : : "r,m"(value) : "memory");
+    }
+
+    template <typename T>
+    inline void doNotOptimize(T &value) {
+        asm volatile("" : "+r,m"(value) : : "memory");
+    }
+
+    // forces pending writes to memory to be completed
+    inline void clobberMemory() {
+        asm volatile("" : : : "memory");
+    }
 } // namespace dtest
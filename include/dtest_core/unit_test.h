@@ -6,6 +6,8 @@
 #pragma once
 
 #include <dtest_core/test.h>
+#include <dtest_core/allocator.h>
+#include <dtest_core/message.h>
 
 namespace dtest {
 
@@ -18,6 +20,17 @@ protected:
     bool _ignoreMemoryLeak = false;
     size_t _memoryBytesLimit = (size_t) -1;
     size_t _memoryBlocksLimit = (size_t) -1;
+    size_t _heapProfileTopN = 0;
+    std::string _heapProfileExport;
+    size_t _memoryTimelineTopN = 0;
+    size_t _allocationHistogramsTopN = 0;
+    bool _allocatorOverhead = false;
+    size_t _crossThreadFreesTopN = 0;
+    bool _stackProfile = false;
+    size_t _stackBytesLimit = (size_t) -1;
+    bool _workingSet = false;
+    bool _counters = false;
+    Allocator _allocator = Allocator::LIBC;
     Buffer _input;
     Buffer _out;
     Buffer _err;
@@ -27,11 +40,20 @@ protected:
     std::function<void()> _onInit;
     std::function<void()> _onComplete;
 
+    // detailed memory report sections
+    std::string _memoryProfile;
+
     // time
     uint64_t _initTime = 0;
     uint64_t _bodyTime = 0;
     uint64_t _completeTime = 0;
 
+    // individual body run times, when the body is run more than once
+    std::vector<double> _bodySamples;
+
+    // allocations made by the body
+    size_t _bodyAllocations = 0;
+
     bool _inProcessSandbox = false;
     bool _resourceSnapshotBodyOnly = false;
 
@@ -41,6 +63,16 @@ protected:
 
     void _checkTimeout(uint64_t time);
 
+    void _profileMemory();
+
+    // runs and times the body, setting _bodyTime and _bodyAllocations
+    virtual void _runBody();
+
+    // extra body results sent by subclasses from the sandbox to the driver
+    virtual void _sendBodyResults(Message &m) { }
+
+    virtual void _recvBodyResults(Message &m) { }
+
     void _driverRun() override;
 
     bool _hasMemoryReport();
@@ -125,6 +157,62 @@ public:
         return *this;
     }
 
+    inline UnitTest & heapProfile(size_t topN = 10) {
+        _heapProfileTopN = topN;
+        return *this;
+    }
+
+    inline UnitTest & heapProfileExport(const std::string &prefix) {
+        _heapProfileExport = prefix;
+        return *this;
+    }
+
+    inline UnitTest & memoryTimeline(size_t topN = 5) {
+        _memoryTimelineTopN = topN;
+        return *this;
+    }
+
+    inline UnitTest & allocationHistograms(size_t topN = 5) {
+        _allocationHistogramsTopN = topN;
+        return *this;
+    }
+
+    inline UnitTest & allocatorOverhead(bool val = true) {
+        _allocatorOverhead = val;
+        return *this;
+    }
+
+    inline UnitTest & crossThreadFrees(size_t topN = 5) {
+        _crossThreadFreesTopN = topN;
+        return *this;
+    }
+
+    inline UnitTest & stackProfile(bool val = true) {
+        _stackProfile = val;
+        return *this;
+    }
+
+    inline UnitTest & stackBytesLimit(size_t bytes) {
+        _stackBytesLimit = bytes;
+        _stackProfile = true;
+        return *this;
+    }
+
+    inline UnitTest & workingSet(bool val = true) {
+        _workingSet = val;
+        return *this;
+    }
+
+    inline UnitTest & counters(bool val = true) {
+        _counters = val;
+        return *this;
+    }
+
+    inline UnitTest & allocator(Allocator allocator) {
+        _allocator = allocator;
+        return *this;
+    }
+
     inline UnitTest & disable() {
         Test::disable();
         return *this;
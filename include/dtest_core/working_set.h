@@ -0,0 +1,50 @@
+/*
+ * Copyright (c) 2021 Noah Orensa.
+ * Licensed under the MIT license. See LICENSE file in the project root for details.
+*/
+
+#pragma once
+
+#include <string>
+#include <cstddef>
+
+namespace dtest {
+
+// measures the pages touched by the process between start() and stop(), by
+// clearing the referenced bits of its pages and reading them back from
+// /proc/self/smaps, along with the page faults taken in between.
+class WorkingSet {
+public:
+
+    struct Usage {
+        bool referencedValid = false;
+        size_t referenced = 0;
+        size_t rss = 0;
+        size_t anonHugePages = 0;
+        long minorFaults = 0;
+        long majorFaults = 0;
+    };
+
+private:
+
+    bool _cleared = false;
+    long _minorFaults = 0;
+    long _majorFaults = 0;
+    Usage _usage;
+
+    static bool _readSmaps(const char *path, Usage &usage);
+
+public:
+
+    void start();
+
+    void stop();
+
+    inline const Usage & usage() const {
+        return _usage;
+    }
+
+    std::string report() const;
+};
+
+}  // end namespace dtest
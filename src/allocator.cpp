@@ -0,0 +1,347 @@
+/*
+ * Copyright (c) 2021 Noah Orensa.
+ * Licensed under the MIT license. See LICENSE file in the project root for details.
+*/
+
+#include <dtest_core/allocator.h>
+#include <dtest_core/sandbox.h>
+#include <atomic>
+#include <mutex>
+#include <malloc.h>
+#include <sys/mman.h>
+
+using namespace dtest;
+
+namespace dtest {
+    AllocatorBackend *_alloc_instance = nullptr;
+}
+
+namespace {
+
+// contiguous range of address space, reserved up front so that ownership of
+// a block is a range check, and committed in steps as it is handed out
+class VirtualRegion {
+private:
+
+    static const size_t _RESERVE = 16lu * 1024 * 1024 * 1024;
+    static const size_t _COMMIT_STEP = 4 * 1024 * 1024;
+
+    char *_base = nullptr;
+    std::atomic<size_t> _used;
+    std::atomic<size_t> _committed;
+    std::mutex _mtx;
+
+public:
+
+    static const size_t SIZE = _RESERVE;
+
+    VirtualRegion()
+    : _used(0),
+      _committed(0)
+    { }
+
+    inline char * base() const {
+        return _base;
+    }
+
+    inline bool contains(const void *ptr) const {
+        return _base != nullptr && ptr >= _base && ptr < _base + _RESERVE;
+    }
+
+    bool reserve() {
+        if (_base != nullptr) return true;
+
+        void *ptr = libc().mmap(
+            nullptr,
+            _RESERVE,
+            PROT_NONE,
+            MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE,
+            -1,
+            0
+        );
+        if (ptr == MAP_FAILED) return false;
+
+        _base = (char *) ptr;
+        return true;
+    }
+
+    // returns size bytes such that (result + offset) is aligned, or nullptr
+    // when the region is exhausted
+    char * take(size_t size, size_t alignment, size_t offset) {
+        size_t used = _used.load();
+        size_t start;
+
+        do {
+            start = ((used + offset + alignment - 1) & ~(alignment - 1)) - offset;
+            if (start + size > _RESERVE) return nullptr;
+        } while (! _used.compare_exchange_weak(used, start + size));
+
+        size_t end = start + size;
+        if (end > _committed.load()) {
+            std::lock_guard<std::mutex> guard(_mtx);
+
+            size_t committed = _committed.load();
+            if (end > committed) {
+                size_t target = (end + _COMMIT_STEP - 1) & ~(_COMMIT_STEP - 1);
+                if (target > _RESERVE) target = _RESERVE;
+
+                if (mprotect(_base + committed, target - committed, PROT_READ | PROT_WRITE) != 0) {
+                    return nullptr;
+                }
+                _committed = target;
+            }
+        }
+
+        return _base + start;
+    }
+};
+
+class ArenaAllocator : public AllocatorBackend {
+private:
+
+    // every block is preceded by its size, keeping the default alignment
+    static const size_t _HEADER = 16;
+
+    VirtualRegion _region;
+
+public:
+
+    inline bool owns(const void *ptr) const {
+        return _region.contains(ptr);
+    }
+
+    void activate() override {
+        _region.reserve();
+    }
+
+    void * allocate(size_t size, size_t alignment) override {
+        if (alignment < _HEADER) alignment = _HEADER;
+
+        char *ptr = _region.take(_HEADER + size, alignment, _HEADER);
+        if (ptr == nullptr) {
+            return (alignment > _HEADER) ? libc().memalign(alignment, size) : libc().malloc(size);
+        }
+
+        *(size_t *) ptr = size;
+        return ptr + _HEADER;
+    }
+
+    void release(void *) override { }
+
+    size_t usableSize(void *ptr) override {
+        return *(size_t *) ((char *) ptr - _HEADER);
+    }
+};
+
+class ThreadCacheAllocator : public AllocatorBackend {
+private:
+
+    // power of two size classes, carved out of spans aligned to their size,
+    // so that every block is aligned to its own size. Larger blocks are
+    // served by libc.
+    static const size_t _MIN_SIZE = 16;
+    static const size_t _CLASSES = 12;        // up to 32 KB
+    static const size_t _SPAN_SHIFT = 16;     // 64 KB
+    static const size_t _SPAN_SIZE = 1lu << _SPAN_SHIFT;
+    static const size_t _BATCH = 32;
+
+    struct FreeBlock {
+        FreeBlock *next;
+    };
+
+    struct FreeList {
+        FreeBlock *head;
+        size_t count;
+    };
+
+    struct Central {
+        std::mutex mtx;
+        FreeList list = { nullptr, 0 };
+    };
+
+    struct Cache {
+        FreeList lists[_CLASSES];
+    };
+
+    static thread_local Cache _cache;
+
+    VirtualRegion _region;
+    Central _central[_CLASSES];
+    unsigned char _spanClass[VirtualRegion::SIZE >> _SPAN_SHIFT];
+
+    static inline size_t _sizeClass(size_t size) {
+        if (size <= _MIN_SIZE) return 0;
+        return 64 - __builtin_clzll(size - 1) - 4;
+    }
+
+    static inline size_t _classSize(size_t sizeClass) {
+        return _MIN_SIZE << sizeClass;
+    }
+
+    static inline void _push(FreeList &list, FreeBlock *block) {
+        block->next = list.head;
+        list.head = block;
+        ++list.count;
+    }
+
+    static inline FreeBlock * _pop(FreeList &list) {
+        FreeBlock *block = list.head;
+        list.head = block->next;
+        --list.count;
+        return block;
+    }
+
+    bool _refill(size_t sizeClass) {
+        auto &central = _central[sizeClass];
+        auto &list = _cache.lists[sizeClass];
+
+        std::lock_guard<std::mutex> guard(central.mtx);
+
+        if (central.list.count == 0) {
+            char *span = _region.take(_SPAN_SIZE, _SPAN_SIZE, 0);
+            if (span == nullptr) return false;
+
+            _spanClass[(span - _region.base()) >> _SPAN_SHIFT] = sizeClass;
+
+            size_t size = _classSize(sizeClass);
+            for (size_t off = _SPAN_SIZE; off >= size; off -= size) {
+                _push(central.list, (FreeBlock *) (span + off - size));
+            }
+        }
+
+        for (size_t i = 0; i < _BATCH && central.list.count > 0; ++i) {
+            _push(list, _pop(central.list));
+        }
+
+        return true;
+    }
+
+    void _drain(size_t sizeClass) {
+        auto &central = _central[sizeClass];
+        auto &list = _cache.lists[sizeClass];
+
+        std::lock_guard<std::mutex> guard(central.mtx);
+
+        for (size_t i = 0; i < _BATCH; ++i) {
+            _push(central.list, _pop(list));
+        }
+    }
+
+public:
+
+    inline bool owns(const void *ptr) const {
+        return _region.contains(ptr);
+    }
+
+    void activate() override {
+        _region.reserve();
+    }
+
+    void * allocate(size_t size, size_t alignment) override {
+        if (alignment > size) size = alignment;
+
+        size_t sizeClass = _sizeClass(size);
+        if (sizeClass >= _CLASSES || _region.base() == nullptr) {
+            return (alignment > 0) ? libc().memalign(alignment, size) : libc().malloc(size);
+        }
+
+        auto &list = _cache.lists[sizeClass];
+        if (list.count == 0 && ! _refill(sizeClass)) {
+            return (alignment > 0) ? libc().memalign(alignment, size) : libc().malloc(size);
+        }
+
+        return _pop(list);
+    }
+
+    void release(void *ptr) override {
+        size_t sizeClass = _spanClass[((char *) ptr - _region.base()) >> _SPAN_SHIFT];
+        auto &list = _cache.lists[sizeClass];
+
+        _push(list, (FreeBlock *) ptr);
+        if (list.count >= 2 * _BATCH) _drain(sizeClass);
+    }
+
+    size_t usableSize(void *ptr) override {
+        return _classSize(_spanClass[((char *) ptr - _region.base()) >> _SPAN_SHIFT]);
+    }
+};
+
+thread_local ThreadCacheAllocator::Cache ThreadCacheAllocator::_cache;
+
+// glibc malloc, keeping freed memory around instead of returning it to the
+// system, and serving large blocks from the heap instead of mmap
+class TunedLibCAllocator : public AllocatorBackend {
+private:
+
+    static const int _MMAP_THRESHOLD = 64 * 1024 * 1024;
+    static const int _TRIM_THRESHOLD = 256 * 1024 * 1024;
+    static const int _TOP_PAD = 16 * 1024 * 1024;
+
+    // documented defaults. Setting any of them disables the dynamic mmap
+    // threshold of glibc, which is not restored.
+    static const int _DEFAULT_THRESHOLD = 128 * 1024;
+
+public:
+
+    void activate() override {
+        mallopt(M_MMAP_THRESHOLD, _MMAP_THRESHOLD);
+        mallopt(M_TRIM_THRESHOLD, _TRIM_THRESHOLD);
+        mallopt(M_TOP_PAD, _TOP_PAD);
+    }
+
+    void deactivate() override {
+        mallopt(M_MMAP_THRESHOLD, _DEFAULT_THRESHOLD);
+        mallopt(M_TRIM_THRESHOLD, _DEFAULT_THRESHOLD);
+        mallopt(M_TOP_PAD, _DEFAULT_THRESHOLD);
+    }
+
+    void * allocate(size_t size, size_t alignment) override {
+        return (alignment > 0) ? libc().memalign(alignment, size) : libc().malloc(size);
+    }
+
+    void release(void *ptr) override {
+        libc().free(ptr);
+    }
+
+    size_t usableSize(void *ptr) override {
+        return libc().malloc_usable_size(ptr);
+    }
+};
+
+// ownership checks only read the region base, which is zero-initialized, so
+// they are safe for frees made before static initialization
+ArenaAllocator arena;
+ThreadCacheAllocator threadCache;
+TunedLibCAllocator tunedLibC;
+
+}  // end anonymous namespace
+
+void dtest::useAllocator(Allocator allocator) {
+    AllocatorBackend *backend = nullptr;
+
+    switch (allocator) {
+    case Allocator::LIBC:
+        break;
+    case Allocator::ARENA:
+        backend = &arena;
+        break;
+    case Allocator::THREAD_CACHE:
+        backend = &threadCache;
+        break;
+    case Allocator::TUNED_LIBC:
+        backend = &tunedLibC;
+        break;
+    }
+
+    if (backend == _alloc_instance) return;
+
+    if (_alloc_instance != nullptr) _alloc_instance->deactivate();
+    if (backend != nullptr) backend->activate();
+    _alloc_instance = backend;
+}
+
+AllocatorBackend * dtest::allocatorOf(const void *ptr) {
+    if (arena.owns(ptr)) return &arena;
+    if (threadCache.owns(ptr)) return &threadCache;
+    return nullptr;
+}
@@ -0,0 +1,32 @@
+/*
+ * Copyright (c) 2021 Noah Orensa.
+ * Licensed under the MIT license. See LICENSE file in the project root for details.
+*/
+
+#include <dtest_core/annotations.h>
+#include <dtest_core/memory.h>
+
+using namespace dtest;
+
+namespace dtest {
+    extern Memory *_mmgr_instance;
+}
+
+// call into the memory manager directly, so that the annotated call site is
+// the first frame of the recorded call stack
+
+void dtest::trackPoolAlloc(const void *pool, void *ptr, size_t size) {
+    if (ptr && _mmgr_instance) _mmgr_instance->track_pooled(pool, ptr, size);
+}
+
+void dtest::trackPoolFree(const void *pool, void *ptr) {
+    if (ptr && _mmgr_instance) _mmgr_instance->remove_pooled(pool, ptr);
+}
+
+void dtest::resetPool(const void *pool) {
+    if (_mmgr_instance) _mmgr_instance->reset_pool(pool);
+}
+
+void dtest::namePool(const void *pool, const char *name) {
+    if (_mmgr_instance) _mmgr_instance->name_pool(pool, name);
+}
@@ -8,11 +8,22 @@
 #include <execinfo.h>
 #include <dlfcn.h>
 #include <cxxabi.h>    // for __cxa_demangle
+#include <dtest_core/util.h>
+#include <link.h>
+#include <unistd.h>
+#include <linux/limits.h>
 #include <sstream>
 #include <cstring>
+#include <mutex>
+#include <regex>
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
 
 using namespace dtest;
 
+bool CallStack::_raw = false;
+
 void CallStack::_dispose() {
     if (_stack != nullptr) libc().free(_stack);
 }
@@ -24,39 +35,293 @@ void CallStack::_copy(const CallStack &rhs) {
     _skip = rhs._skip;
 }
 
+// symbolized and raw frames are cached for the lifetime of the process. The
+// cache is only accessed while the sandbox is locked, so that its memory is
+// never tracked.
+
+typedef std::unordered_map<void *, std::string> FrameCache;
+
+static std::mutex cacheMtx;
+static FrameCache *symbolCache = nullptr;
+static FrameCache *rawCache = nullptr;
+static FrameCache *nameCache = nullptr;
+
+static std::string executablePath() {
+    char path[PATH_MAX];
+    ssize_t len = readlink("/proc/self/exe", path, sizeof(path) - 1);
+    if (len < 0) len = 0;
+    path[len] = '\0';
+    return path;
+}
+
+// absolute path of a module, as it may have been loaded through a relative one
+static std::string modulePath(const char *name) {
+    if (name[0] == '\0') return executablePath();
+
+    char path[PATH_MAX];
+    return (realpath(name, path) == nullptr) ? name : path;
+}
+
+static std::string symbolizeFrame(void *address) {
+    char buf[1024];
+
+    Dl_info info;
+    if (! dladdr(address, &info)) {
+        char **symbols = backtrace_symbols(&address, 1);
+        snprintf(buf, sizeof(buf), "%s", symbols[0]);
+        free(symbols);
+    }
+    else if (info.dli_sname == nullptr) {
+        // no dynamic symbol covers the address (e.g. a static function)
+        snprintf(
+            buf, sizeof(buf), "%s + %p",
+            info.dli_fname,
+            (void *) ((char *) address - (char *) info.dli_fbase)
+        );
+    }
+    else {
+        int status;
+        char *demangled = abi::__cxa_demangle(info.dli_sname, NULL, 0, &status);
+        snprintf(
+            buf, sizeof(buf), "%s + %p",
+            status == 0 ? demangled : info.dli_sname,
+            (void *) ((char *) address - (char *) info.dli_saddr)
+        );
+        free(demangled);
+    }
+
+    return buf;
+}
+
+struct ModuleLookup {
+    const void *address;
+    std::string path;
+    uintptr_t base;
+};
+
+static int findModule(struct dl_phdr_info *info, size_t, void *data) {
+    auto lookup = (ModuleLookup *) data;
+    uintptr_t address = (uintptr_t) lookup->address;
+
+    for (int i = 0; i < info->dlpi_phnum; ++i) {
+        const auto &phdr = info->dlpi_phdr[i];
+        if (phdr.p_type != PT_LOAD) continue;
+
+        uintptr_t low = info->dlpi_addr + phdr.p_vaddr;
+        if (address >= low && address < low + phdr.p_memsz) {
+            lookup->path = modulePath(info->dlpi_name);
+            lookup->base = info->dlpi_addr;
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+static std::string rawFrame(void *address) {
+    char buf[PATH_MAX + 32];
+
+    ModuleLookup lookup = { address, "", 0 };
+    if (dl_iterate_phdr(findModule, &lookup) == 0) {
+        snprintf(buf, sizeof(buf), "[?+%p]", address);
+    }
+    else {
+        snprintf(
+            buf, sizeof(buf), "[%s+%p]",
+            lookup.path.c_str(),
+            (void *) ((uintptr_t) address - lookup.base)
+        );
+    }
+
+    return buf;
+}
+
+static const std::string * cachedFrame(
+    FrameCache *&cache,
+    void *address,
+    std::string (*resolve)(void *)
+) {
+    if (cache == nullptr) cache = new FrameCache();
+
+    auto it = cache->find(address);
+    if (it == cache->end()) it = cache->insert({ address, resolve(address) }).first;
+
+    return &it->second;
+}
+
 std::string CallStack::toString() const noexcept {
     std::stringstream s;
     char buf[1024];
 
-    char **symbols = backtrace_symbols(_stack, _len);
+    // cache entries are never removed, so they can be read after unlocking.
+    // A stack never holds more than _MAX_STACK_FRAMES frames past _skip.
+    const std::string *frames[_MAX_STACK_FRAMES];
+
+    sandbox().lock();
+    cacheMtx.lock();
+    for (int i = _skip; i < _len; ++i) {
+        frames[i - _skip] = _raw
+            ? cachedFrame(rawCache, _stack[i], rawFrame)
+            : cachedFrame(symbolCache, _stack[i], symbolizeFrame);
+    }
+    cacheMtx.unlock();
+    sandbox().unlock();
 
     for (int i = _skip; i < _len; i++) {
-        Dl_info info;
-        if (dladdr(_stack[i], &info)) {
-            char *demangled = NULL;
-            int status;
-            demangled = abi::__cxa_demangle(info.dli_sname, NULL, 0, &status);
-            snprintf(
-                buf, sizeof(buf), "%-3d  %p  %s + %p%s",
-                _len - i - 1, _stack[i],
-                status == 0 ? demangled : info.dli_sname,
-                (void *) ((char *)_stack[i] - (char *)info.dli_saddr),
-                (i == _len - 1) ? "" : "\n"
-            );
-            free(demangled);
+        snprintf(
+            buf, sizeof(buf), "%-3d  %p  %s%s",
+            _len - i - 1, _stack[i],
+            frames[i - _skip]->c_str(),
+            (i == _len - 1) ? "" : "\n"
+        );
+        s << buf;
+    }
+    if (_len == CallStack::_MAX_STACK_FRAMES + _skip) s << "\n[truncated]";
+
+    return s.str();
+}
+
+size_t CallStack::hash() const noexcept {
+    size_t h = 14695981039346656037lu;
+
+    for (int i = _skip; i < _len; ++i) {
+        h ^= (size_t) _stack[i];
+        h *= 1099511628211lu;
+    }
+
+    return h;
+}
+
+bool CallStack::operator==(const CallStack &rhs) const noexcept {
+    return size() == rhs.size()
+        && memcmp(stack(), rhs.stack(), size() * sizeof(void *)) == 0;
+}
+
+static std::string resolveSymbolName(void *address) {
+    char buf[1024];
+
+    Dl_info info;
+    if (! dladdr(address, &info)) {
+        snprintf(buf, sizeof(buf), "%p", address);
+    }
+    else if (info.dli_sname != nullptr) {
+        int status;
+        char *demangled = abi::__cxa_demangle(info.dli_sname, NULL, 0, &status);
+        snprintf(buf, sizeof(buf), "%s", status == 0 ? demangled : info.dli_sname);
+        free(demangled);
+    }
+    else {
+        const char *name = strrchr(info.dli_fname, '/');
+        snprintf(
+            buf, sizeof(buf), "%s + %p",
+            name == nullptr ? info.dli_fname : name + 1,
+            (void *) ((char *) address - (char *) info.dli_fbase)
+        );
+    }
+
+    return buf;
+}
+
+std::string CallStack::symbolName(void *address) noexcept {
+    sandbox().lock();
+    cacheMtx.lock();
+    auto name = cachedFrame(nameCache, address, resolveSymbolName);
+    cacheMtx.unlock();
+    sandbox().unlock();
+
+    return *name;
+}
+
+static int listModule(struct dl_phdr_info *info, size_t, void *data) {
+    auto modules = (std::vector<std::string> *) data;
+
+    uintptr_t low = UINTPTR_MAX;
+    uintptr_t high = 0;
+    for (int i = 0; i < info->dlpi_phnum; ++i) {
+        const auto &phdr = info->dlpi_phdr[i];
+        if (phdr.p_type != PT_LOAD) continue;
+
+        low = std::min(low, (uintptr_t) (info->dlpi_addr + phdr.p_vaddr));
+        high = std::max(high, (uintptr_t) (info->dlpi_addr + phdr.p_vaddr + phdr.p_memsz));
+    }
+    if (low >= high) return 0;
+
+    char buf[PATH_MAX + 64];
+    snprintf(
+        buf, sizeof(buf), "%p-%p %s",
+        (void *) low, (void *) high,
+        modulePath(info->dlpi_name).c_str()
+    );
+    modules->push_back(buf);
+
+    return 0;
+}
+
+std::string CallStack::moduleMap() {
+    std::vector<std::string> modules;
+    dl_iterate_phdr(listModule, &modules);
+    return jsonify(modules, 2);
+}
+
+static int findMainModule(struct dl_phdr_info *info, size_t, void *data) {
+    if (info->dlpi_name[0] != '\0') return 0;
+
+    *(uintptr_t *) data = info->dlpi_addr;
+    return 1;
+}
+
+// base address of the given module in this process, loading it if needed
+static bool moduleBase(const std::string &path, uintptr_t &base) {
+    if (path == executablePath()) {
+        return dl_iterate_phdr(findMainModule, &base) != 0;
+    }
+
+    // the module stays loaded, along with the loader's bookkeeping
+    sandbox().lock();
+    void *handle = dlopen(path.c_str(), RTLD_LAZY | RTLD_LOCAL);
+    sandbox().unlock();
+    if (handle == nullptr) return false;
+
+    struct link_map *map;
+    if (dlinfo(handle, RTLD_DI_LINKMAP, &map) != 0) return false;
+
+    base = map->l_addr;
+    return true;
+}
+
+std::string CallStack::symbolize(const std::string &text) {
+    const std::regex frame("\\[([^\\]\"]+)\\+(0x[0-9a-f]+)\\]");
+
+    std::unordered_map<std::string, uintptr_t> bases;
+    std::stringstream s;
+    auto last = text.cbegin();
+
+    for (
+        std::sregex_iterator it(text.cbegin(), text.cend(), frame), end;
+        it != end;
+        ++it
+    ) {
+        const auto &match = *it;
+        s << std::string(last, match[0].first);
+        last = match[0].second;
+
+        auto path = match[1].str();
+        auto base = bases.find(path);
+        if (base == bases.end()) {
+            uintptr_t address = 0;
+            if (! moduleBase(path, address)) address = UINTPTR_MAX;
+            base = bases.insert({ path, address }).first;
+        }
+
+        if (base->second == UINTPTR_MAX) {
+            s << match[0].str();
         }
         else {
-            snprintf(
-                buf, sizeof(buf), "%-3d  %p  %s%s",
-                _len - i - 1, _stack[i],
-                symbols[i],
-                (i == _len - 1) ? "" : "\n"
-            );
+            void *address = (void *) (base->second + std::stoull(match[2].str(), nullptr, 16));
+            s << symbolizeFrame(address);
         }
-        s << buf;
     }
-    free(symbols);
-    if (_len == CallStack::_MAX_STACK_FRAMES + _skip) s << "\n[truncated]";
+    s << std::string(last, text.cend());
 
     return s.str();
 }
@@ -68,3 +333,14 @@ CallStack CallStack::trace(int skip) {
 
     return { nFrames, stack, skip };
 }
+
+int CallStack::shallowTrace(void **frames, int depth, int skip) {
+    ++skip;
+    void *stack[_MAX_STACK_FRAMES];
+    int nFrames = backtrace(stack, (depth + skip < _MAX_STACK_FRAMES) ? depth + skip : _MAX_STACK_FRAMES) - skip;
+
+    if (nFrames <= 0) return 0;
+
+    memcpy(frames, stack + skip, nFrames * sizeof(void *));
+    return nFrames;
+}
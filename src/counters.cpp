@@ -0,0 +1,155 @@
+/*
+ * Copyright (c) 2021 Noah Orensa.
+ * Licensed under the MIT license. See LICENSE file in the project root for details.
+*/
+
+#include <dtest_core/counters.h>
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#include <string.h>
+#include <sstream>
+
+using namespace dtest;
+
+static const char *eventNames[CounterValues::EVENTS] = {
+    "cycles",
+    "instructions",
+    "cacheReferences",
+    "cacheMisses",
+    "branchMisses",
+    "dtlbMisses",
+    "taskClock",
+    "contextSwitches",
+    "pageFaults",
+};
+
+CounterValues CounterValues::operator-(const CounterValues &other) const {
+    CounterValues r;
+    r.valid = valid;
+    for (size_t i = 0; i < EVENTS; ++i) {
+        r.value[i] = value[i] > other.value[i] ? value[i] - other.value[i] : 0;
+    }
+    return r;
+}
+
+CounterValues & CounterValues::operator+=(const CounterValues &other) {
+    valid |= other.valid;
+    for (size_t i = 0; i < EVENTS; ++i) value[i] += other.value[i];
+    return *this;
+}
+
+std::string CounterValues::report(double n) const {
+    std::stringstream s;
+    s.setf(std::ios::fixed);
+    s.precision(3);
+
+    s << "\"source\": \"" << (hardware() ? "hardware" : "software") << "\"";
+
+    for (size_t i = 0; i < EVENTS; ++i) {
+        if (! has((Event) i)) continue;
+        s << ",\n\"" << eventNames[i] << "\": " << value[i] / n;
+    }
+
+    if (has(CYCLES) && has(INSTRUCTIONS) && value[CYCLES] > 0) {
+        s << ",\n\"ipc\": " << (double) value[INSTRUCTIONS] / value[CYCLES];
+    }
+
+    return s.str();
+}
+
+Counters::Counters() {
+    for (auto &fd : _fd) fd = -1;
+}
+
+int Counters::_openEvent(uint32_t type, uint64_t config, bool kernel) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.exclude_kernel = kernel ? 0 : 1;
+    attr.exclude_hv = 1;
+    attr.inherit = 1;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+    return syscall(SYS_perf_event_open, &attr, 0, -1, -1, PERF_FLAG_FD_CLOEXEC);
+}
+
+void Counters::open() {
+    if (_open) return;
+
+    static const uint64_t dtlb = PERF_COUNT_HW_CACHE_DTLB
+        | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+        | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+
+    _fd[CounterValues::CYCLES] = _openEvent(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+    _fd[CounterValues::INSTRUCTIONS] = _openEvent(PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+
+    // without the core events the PMU is assumed to be unavailable
+    if (_fd[CounterValues::CYCLES] != -1 || _fd[CounterValues::INSTRUCTIONS] != -1) {
+        _fd[CounterValues::CACHE_REFERENCES] = _openEvent(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_REFERENCES);
+        _fd[CounterValues::CACHE_MISSES] = _openEvent(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+        _fd[CounterValues::BRANCH_MISSES] = _openEvent(PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES);
+        _fd[CounterValues::DTLB_MISSES] = _openEvent(PERF_TYPE_HW_CACHE, dtlb);
+    }
+
+    // the software events are counted in kernel mode as well where
+    // perf_event_paranoid allows it, and context switches, which only ever
+    // happen in kernel mode, are not counted otherwise
+    _fd[CounterValues::TASK_CLOCK] = _openEvent(PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK, true);
+    if (_fd[CounterValues::TASK_CLOCK] == -1) {
+        _fd[CounterValues::TASK_CLOCK] = _openEvent(PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK);
+    }
+
+    _fd[CounterValues::CONTEXT_SWITCHES] = _openEvent(PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES, true);
+
+    _fd[CounterValues::PAGE_FAULTS] = _openEvent(PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS, true);
+    if (_fd[CounterValues::PAGE_FAULTS] == -1) {
+        _fd[CounterValues::PAGE_FAULTS] = _openEvent(PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS);
+    }
+
+    _open = true;
+}
+
+void Counters::close() {
+    for (auto &fd : _fd) {
+        if (fd != -1) ::close(fd);
+        fd = -1;
+    }
+    _open = false;
+}
+
+void Counters::read(CounterValues &values) const {
+    values = CounterValues();
+    if (! _open) return;
+
+    for (size_t i = 0; i < CounterValues::EVENTS; ++i) {
+        if (_fd[i] == -1) continue;
+
+        // value, time enabled, time running
+        uint64_t data[3];
+        if (::read(_fd[i], data, sizeof(data)) != sizeof(data)) continue;
+
+        // scaled up if the event was multiplexed with others
+        values.value[i] = (data[2] > 0 && data[2] < data[1])
+            ? (uint64_t) ((double) data[0] * data[1] / data[2])
+            : data[0];
+        values.valid |= 1u << i;
+    }
+
+    if (_fd[CounterValues::TASK_CLOCK] == -1) {
+        struct rusage r;
+        getrusage(RUSAGE_SELF, &r);
+
+        values.value[CounterValues::TASK_CLOCK] =
+            (r.ru_utime.tv_sec + r.ru_stime.tv_sec) * 1000000000lu
+            + (r.ru_utime.tv_usec + r.ru_stime.tv_usec) * 1000lu;
+        values.value[CounterValues::CONTEXT_SWITCHES] = r.ru_nvcsw + r.ru_nivcsw;
+        values.value[CounterValues::PAGE_FAULTS] = r.ru_minflt + r.ru_majflt;
+        values.valid |= (1u << CounterValues::TASK_CLOCK)
+            | (1u << CounterValues::CONTEXT_SWITCHES)
+            | (1u << CounterValues::PAGE_FAULTS);
+    }
+}
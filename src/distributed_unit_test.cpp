@@ -28,6 +28,7 @@ void DistributedUnitTest::_workerRun() {
         _timeout < 2000000000lu ? 2000000000lu : _timeout,
         [this] {
             _configure();
+            if (_counters) sandbox().openCounters();
 
             _status = Status::FAIL;
 
@@ -35,27 +36,37 @@ void DistributedUnitTest::_workerRun() {
             timeOf(_onInit);
 
             if (_resourceSnapshotBodyOnly) sandbox().resourceSnapshot(_usedResources);
+            if (_stackProfile) sandbox().startStackProfile();
+            if (_workingSet) sandbox().startWorkingSet();
+            useAllocator(_allocator);
             _workerBodyTime = timeOf(_workerBody);
+            useAllocator(Allocator::LIBC);
+            if (_workingSet) sandbox().stopWorkingSet();
+            if (_stackProfile) sandbox().stopStackProfile();
             if (_resourceSnapshotBodyOnly) sandbox().resourceSnapshot(_usedResources);
 
             timeOf(_onComplete);
             if (! _resourceSnapshotBodyOnly) sandbox().resourceSnapshot(_usedResources);
+            sandbox().closeCounters();
 
             _status = Status::PASS;
         },
         [this] (Message &m) {
             _checkMemoryLeak();
             _checkTimeout(_bodyTime);
+            _profileMemory();
 
             m << _status
                 << _usedResources
                 << _errors
+                << _memoryProfile
                 << _workerBodyTime;
         },
         [this] (Message &m) {
             m >> _status
                 >> _usedResources
                 >> _errors
+                >> _memoryProfile
                 >> _workerBodyTime;
         },
         [this] (const std::string &error) {
@@ -65,6 +76,7 @@ void DistributedUnitTest::_workerRun() {
         opt
     );
 
+    if (opt.fatalError() == FatalError::MEMORY_LIMIT_EXCEEDED) _status = Status::MEMORY_LIMIT_EXCEEDED;
     if (! finish) _status = Status::TIMEOUT;
 }
 
@@ -110,6 +122,10 @@ void DistributedUnitTest::_report(bool driver, std::stringstream &s) {
         if (_hasMemoryReport()) {
             s << ",\n\"memory\": {\n" << indent(_memoryReport(), 2) << "\n}";
         }
+
+        if (_usedResources.counters.valid) {
+            s << ",\n\"counters\": {\n" << indent(_usedResources.counters.report(), 2) << "\n}";
+        }
     }
 
     if (_hasNetworkReport()) {
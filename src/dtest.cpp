@@ -71,6 +71,18 @@ static void findTests(const char *path) {
     }
 }
 
+static void symbolize(const char *path) {
+    std::ifstream in(path);
+    if (! in) {
+        std::cerr << "Could not open '" << path << "'\n\n";
+        exit(1);
+    }
+
+    std::stringstream s;
+    s << in.rdbuf();
+    std::cout << CallStack::symbolize(s.str());
+}
+
 void printHelp() {
     std::cout <<
         "Usage: dtest <options> <test directories or files>\n"
@@ -83,6 +95,11 @@ void printHelp() {
         "                               identifier.\n"
         "    --module <test-module>     Runs one or more test modules and skips all other\n"
         "                               tests.\n"
+        "    --suppressions <file>      Loads memory tracking suppressions from <file>.\n"
+        "    --raw-stacks               Writes call stacks as unsymbolized addresses,\n"
+        "                               to be resolved later with --symbolize.\n"
+        "    --symbolize <log-file>     Resolves the raw call stacks found in <log-file>\n"
+        "                               and prints the result to stdout.\n"
         "\n\n"
     ;
 }
@@ -111,6 +128,20 @@ void parseArguments(int argc, char *argv[], const char *cwd) {
             else if (strcasecmp(argv[i], "--module") == 0) {
                 modules.insert(argv[++i]);
             }
+            else if (strcasecmp(argv[i], "--suppressions") == 0) {
+                std::string error;
+                if (! Memory::loadSuppressions(argv[++i], error)) {
+                    std::cerr << error << "\n\n";
+                    exit(1);
+                }
+            }
+            else if (strcasecmp(argv[i], "--raw-stacks") == 0) {
+                CallStack::rawMode(true);
+            }
+            else if (strcasecmp(argv[i], "--symbolize") == 0) {
+                symbolize(argv[++i]);
+                exit(0);
+            }
             else if (strcasecmp(argv[i], "-h") == 0 || strcasecmp(argv[i], "--help") == 0) {
                 printHelp();
                 exit(0);
@@ -156,13 +187,16 @@ int main(int argc, char *argv[]) {
     std::fstream logFile;
     logFile.open("dtest.log.json", std::ios_base::out | std::ios_base::trunc);
 
+    std::vector<std::pair<std::string, std::string>> config = {
+        { "executable", argv[0] },
+        { "args", jsonify(argc - 1, argv + 1, 2) },
+        { "working_dir", cwd },
+        { "loaded_test_files", jsonify(dynamicTests, 2) },
+    };
+    if (CallStack::rawMode()) config.push_back({ "modules", CallStack::moduleMap() });
+
     bool success = Test::runAll(
-        {
-            { "executable", argv[0] },
-            { "args", jsonify(argc - 1, argv + 1, 2) },
-            { "working_dir", cwd },
-            { "loaded_test_files", jsonify(dynamicTests, 2) },
-        },
+        config,
         modules,
         logFile
     );
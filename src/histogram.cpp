@@ -0,0 +1,47 @@
+/*
+ * Copyright (c) 2021 Noah Orensa.
+ * Licensed under the MIT license. See LICENSE file in the project root for details.
+*/
+
+#include <dtest_core/histogram.h>
+#include <sstream>
+
+using namespace dtest;
+
+uint64_t Log2Histogram::percentile(double p) const {
+    if (_total == 0) return 0;
+
+    uint64_t target = p * _total;
+    if (target >= _total) target = _total - 1;
+
+    uint64_t sum = 0;
+    for (size_t i = 0; i < BUCKETS; ++i) {
+        sum += _counts[i];
+        if (sum > target) return lowerBound(i);
+    }
+
+    return lowerBound(BUCKETS - 1);
+}
+
+size_t Log2Histogram::spread() const {
+    size_t n = 0;
+    for (size_t i = 0; i < BUCKETS; ++i) {
+        if (_counts[i] > 0) ++n;
+    }
+    return n;
+}
+
+std::string Log2Histogram::toString() const {
+    std::stringstream s;
+
+    s << "[";
+    size_t n = 0;
+    for (size_t i = 0; i < BUCKETS; ++i) {
+        if (_counts[i] == 0) continue;
+        if (n++ > 0) s << ",";
+        s << "\n  [ " << lowerBound(i) << ", " << _counts[i] << " ]";
+    }
+    s << (n > 0 ? "\n]" : " ]");
+
+    return s.str();
+}
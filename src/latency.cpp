@@ -0,0 +1,173 @@
+/*
+ * Copyright (c) 2021 Noah Orensa.
+ * Licensed under the MIT license. See LICENSE file in the project root for details.
+*/
+
+#include <dtest_core/latency.h>
+#include <dtest_core/sandbox.h>
+#include <dtest_core/util.h>
+#include <chrono>
+#include <sstream>
+#include <cmath>
+
+using namespace dtest;
+
+static inline int msb(uint64_t x) {
+    return 63 - __builtin_clzll(x);
+}
+
+size_t LatencyHistogram::_bucket(uint64_t nanos) {
+    if (nanos < 128) return nanos;
+
+    // keep the 7 most significant bits
+    int shift = msb(nanos) - 6;
+    return 128 + (shift - 1) * 64 + ((nanos >> shift) - 64);
+}
+
+uint64_t LatencyHistogram::lowest(size_t bucket) {
+    if (bucket < 128) return bucket;
+
+    size_t shift = (bucket - 128) / 64 + 1;
+    return (64 + (bucket - 128) % 64) << shift;
+}
+
+uint64_t LatencyHistogram::highest(size_t bucket) {
+    if (bucket < 128) return bucket;
+
+    size_t shift = (bucket - 128) / 64 + 1;
+    return lowest(bucket) + ((uint64_t) 1 << shift) - 1;
+}
+
+LatencyHistogram::LatencyHistogram() {
+    reset();
+}
+
+void LatencyHistogram::record(uint64_t nanos) {
+    _counts[_bucket(nanos)].fetch_add(1, std::memory_order_relaxed);
+    _total.fetch_add(1, std::memory_order_relaxed);
+    _sum.fetch_add(nanos, std::memory_order_relaxed);
+
+    uint64_t min = _min.load(std::memory_order_relaxed);
+    while (nanos < min && ! _min.compare_exchange_weak(min, nanos, std::memory_order_relaxed));
+
+    uint64_t max = _max.load(std::memory_order_relaxed);
+    while (nanos > max && ! _max.compare_exchange_weak(max, nanos, std::memory_order_relaxed));
+}
+
+void LatencyHistogram::reset() {
+    for (auto &c : _counts) c.store(0, std::memory_order_relaxed);
+    _total.store(0, std::memory_order_relaxed);
+    _sum.store(0, std::memory_order_relaxed);
+    _min.store((uint64_t) -1, std::memory_order_relaxed);
+    _max.store(0, std::memory_order_relaxed);
+}
+
+uint64_t LatencyHistogram::percentile(double p) const {
+    uint64_t total = count();
+    if (total == 0) return 0;
+
+    uint64_t rank = std::ceil(p * total);
+    if (rank < 1) rank = 1;
+    if (rank > total) rank = total;
+
+    uint64_t seen = 0;
+    for (size_t i = 0; i < BUCKETS; ++i) {
+        seen += _counts[i].load(std::memory_order_relaxed);
+        if (seen >= rank) {
+            uint64_t value = highest(i);
+            return value < max() ? value : max();
+        }
+    }
+
+    return max();
+}
+
+void LatencyHistogram::save(
+    std::vector<uint32_t> &buckets,
+    std::vector<uint64_t> &counts,
+    uint64_t &sum,
+    uint64_t &min,
+    uint64_t &max
+) const {
+    buckets.clear();
+    counts.clear();
+
+    for (size_t i = 0; i < BUCKETS; ++i) {
+        uint64_t c = _counts[i].load(std::memory_order_relaxed);
+        if (c == 0) continue;
+        buckets.push_back(i);
+        counts.push_back(c);
+    }
+
+    sum = _sum.load(std::memory_order_relaxed);
+    min = _min.load(std::memory_order_relaxed);
+    max = _max.load(std::memory_order_relaxed);
+}
+
+void LatencyHistogram::load(
+    const std::vector<uint32_t> &buckets,
+    const std::vector<uint64_t> &counts,
+    uint64_t sum,
+    uint64_t min,
+    uint64_t max
+) {
+    reset();
+
+    uint64_t total = 0;
+    for (size_t i = 0; i < buckets.size() && i < counts.size(); ++i) {
+        if (buckets[i] >= BUCKETS) continue;
+        _counts[buckets[i]].store(counts[i], std::memory_order_relaxed);
+        total += counts[i];
+    }
+
+    _total.store(total, std::memory_order_relaxed);
+    _sum.store(sum, std::memory_order_relaxed);
+    _min.store(min, std::memory_order_relaxed);
+    _max.store(max, std::memory_order_relaxed);
+}
+
+std::string LatencyHistogram::report() const {
+    static const double percentiles[] = { 0.5, 0.75, 0.9, 0.95, 0.99, 0.999, 0.9999, 0.99999 };
+    static const char *names[] = { "p50", "p75", "p90", "p95", "p99", "p99.9", "p99.99", "p99.999" };
+
+    std::stringstream s;
+
+    s << "\"count\": " << count();
+    s << ",\n\"min\": " << formatDurationJSON(min());
+    s << ",\n\"mean\": " << formatDurationJSON(mean());
+    s << ",\n\"max\": " << formatDurationJSON(max());
+
+    s << ",\n\"percentiles\": {";
+    for (size_t i = 0; i < sizeof(percentiles) / sizeof(percentiles[0]); ++i) {
+        if (i > 0) s << ",";
+        s << "\n  \"" << names[i] << "\": " << formatDurationJSON(percentile(percentiles[i]));
+    }
+    s << "\n}";
+
+    // raw bucket counts, as [lowest value in ns, count] pairs
+    s << ",\n\"histogram\": [";
+    bool first = true;
+    for (size_t i = 0; i < BUCKETS; ++i) {
+        uint64_t c = _counts[i].load(std::memory_order_relaxed);
+        if (c == 0) continue;
+        if (! first) s << ",";
+        s << "\n  [" << lowest(i) << ", " << c << "]";
+        first = false;
+    }
+    s << "\n]";
+
+    return s.str();
+}
+
+LatencyTimer::LatencyTimer()
+: _start(std::chrono::high_resolution_clock::now().time_since_epoch().count())
+{ }
+
+LatencyTimer::~LatencyTimer() {
+    uint64_t end = std::chrono::high_resolution_clock::now().time_since_epoch().count();
+    recordLatency(end - _start);
+}
+
+void dtest::recordLatency(uint64_t nanos) {
+    sandbox().recordLatency(nanos);
+}
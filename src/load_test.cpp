@@ -0,0 +1,194 @@
+/*
+ * Copyright (c) 2021 Noah Orensa.
+ * Licensed under the MIT license. See LICENSE file in the project root for details.
+*/
+
+#include <dtest_core/load_test.h>
+#include <dtest_core/sandbox.h>
+#include <dtest_core/random.h>
+#include <dtest_core/util.h>
+#include <chrono>
+#include <thread>
+#include <atomic>
+
+using namespace dtest;
+
+static inline uint64_t now() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()
+    ).count();
+}
+
+// waits until the given time, sleeping while it is far enough away
+static void waitUntil(uint64_t time) {
+    uint64_t t = now();
+    if (t + 100000 < time) {
+        std::this_thread::sleep_for(std::chrono::nanoseconds(time - t - 50000));
+    }
+    while (now() < time);
+}
+
+uint64_t LoadTest::_generate(double rate, uint64_t start, uint64_t end, double offset) {
+    uint64_t last = start;
+    double scheduled = start + offset;
+
+    while (true) {
+        scheduled += (_arrivals == Arrivals::POISSON)
+            ? frand_expDist(rate) * 1e9
+            : 1e9 / rate;
+        if (scheduled >= end) break;
+
+        // requests are sent at their scheduled time, or right away if the
+        // generator is behind, and their latency includes the delay
+        waitUntil(scheduled);
+        _body();
+        last = now();
+
+        sandbox().recordLatency(last - (uint64_t) scheduled);
+    }
+
+    return last;
+}
+
+double LoadTest::_saturationRate() const {
+    for (const auto &r : _results) {
+        // the requests scheduled during the run have to complete within
+        // 1 / _SATURATION of its duration. Unlike the achieved rate, this does
+        // not depend on how many requests random arrivals happened to schedule.
+        if (r.elapsed * _SATURATION > _duration) return r.offered;
+    }
+    return 0;
+}
+
+void LoadTest::_runBody() {
+    sandbox().lock();
+    _results.clear();
+    _results.reserve(_rates.size());
+    sandbox().unlock();
+
+    _bodyTime = 0;
+    _bodyAllocations = sandbox().memoryAllocationCount();
+
+    for (auto rate : _rates) {
+        if (rate <= 0) continue;
+
+        sandbox().resetLatency();
+
+        // the first generator runs on this thread
+        uint64_t start = now();
+        uint64_t end = start + _duration;
+        double perGenerator = rate / _generators;
+        std::atomic<uint64_t> last(start);
+
+        // evenly spaced generators are staggered by the aggregate interval,
+        // so that they do not all send at the same instants
+        double stagger = (_arrivals == Arrivals::CONSTANT) ? 1e9 / rate : 0;
+
+        std::vector<std::thread> generators;
+        for (size_t i = 1; i < _generators; ++i) {
+            generators.emplace_back([this, perGenerator, start, end, &last, stagger, i] {
+                uint64_t t = _generate(perGenerator, start, end, i * stagger);
+                uint64_t l = last.load();
+                while (t > l && ! last.compare_exchange_weak(l, t));
+            });
+        }
+
+        uint64_t t = _generate(perGenerator, start, end, 0);
+        for (auto &g : generators) g.join();
+        if (t > last) last = t;
+
+        const auto &latency = sandbox().latency();
+        uint64_t elapsed = (last > end ? last.load() : end) - start;
+
+        RateResult r;
+        r.offered = rate;
+        r.requests = latency.count();
+        r.elapsed = elapsed;
+        r.achieved = r.requests / (elapsed / 1e9);
+        r.mean = latency.mean();
+        r.p50 = latency.percentile(0.5);
+        r.p90 = latency.percentile(0.9);
+        r.p99 = latency.percentile(0.99);
+        r.p999 = latency.percentile(0.999);
+        r.max = latency.max();
+
+        sandbox().lock();
+        _results.push_back(r);
+        sandbox().unlock();
+
+        _bodyTime += elapsed;
+    }
+
+    _bodyAllocations = sandbox().memoryAllocationCount() - _bodyAllocations;
+}
+
+void LoadTest::_sendBodyResults(Message &m) {
+    m << _results;
+}
+
+void LoadTest::_recvBodyResults(Message &m) {
+    m >> _results;
+}
+
+void LoadTest::_driverRun() {
+    UnitTest::_driverRun();
+
+    if (_results.empty() || _minSaturationRate <= 0) return;
+
+    double saturation = _saturationRate();
+    if (saturation > 0 && saturation < _minSaturationRate) {
+        _status = Status::TOO_SLOW;
+        err(
+            "Saturated at " + std::to_string(saturation) + " requests/s, below the minimum of "
+            + std::to_string(_minSaturationRate) + " requests/s"
+        );
+    }
+}
+
+std::string LoadTest::_loadReport() {
+    std::stringstream s;
+    s.setf(std::ios::fixed);
+    s.precision(3);
+
+    s << "\"load\": {";
+    s << "\n  \"arrivals\": " << (_arrivals == Arrivals::POISSON ? "\"poisson\"" : "\"constant\"");
+    s << ",\n  \"generators\": " << _generators;
+    s << ",\n  \"duration\": " << formatDurationJSON(_duration);
+
+    s << ",\n  \"rates\": [";
+    for (size_t i = 0; i < _results.size(); ++i) {
+        const auto &r = _results[i];
+
+        if (i > 0) s << ",";
+        s << "\n    {";
+        s << "\n      \"offered\": " << r.offered;
+        s << ",\n      \"achieved\": " << r.achieved;
+        s << ",\n      \"requests\": " << r.requests;
+        s << ",\n      \"latency\": {";
+        s << "\n        \"mean\": " << formatDurationJSON(r.mean);
+        s << ",\n        \"p50\": " << formatDurationJSON(r.p50);
+        s << ",\n        \"p90\": " << formatDurationJSON(r.p90);
+        s << ",\n        \"p99\": " << formatDurationJSON(r.p99);
+        s << ",\n        \"p99.9\": " << formatDurationJSON(r.p999);
+        s << ",\n        \"max\": " << formatDurationJSON(r.max);
+        s << "\n      }";
+        s << "\n    }";
+    }
+    s << "\n  ]";
+
+    double saturation = _saturationRate();
+    if (saturation > 0) s << ",\n  \"saturation\": " << saturation;
+    else s << ",\n  \"saturation\": null";
+
+    s << "\n}";
+
+    return s.str();
+}
+
+void LoadTest::_report(bool driver, std::stringstream &s) {
+    UnitTest::_report(driver, s);
+
+    if (! _results.empty()) {
+        s << ",\n" << _loadReport();
+    }
+}
@@ -5,118 +5,315 @@
 
 #include <dtest_core/memory.h>
 #include <dtest_core/sandbox.h>
+#include <dtest_core/util.h>
 #include <sstream>
+#include <algorithm>
 #include <elf.h>
 #include <link.h>
+#include <fstream>
+#include <cstring>
+#include <malloc.h>
+#include <fcntl.h>
+#include <unistd.h>
 
 using namespace dtest;
 
 thread_local size_t Memory::_locked = false;
+thread_local uint32_t Memory::_thread = 0;
+thread_local AllocationBudget * Memory::_budget = nullptr;
 
 namespace dtest {
     Memory *_mmgr_instance = nullptr;
 }
 
-struct TrackingException {
-    size_t stackPos;
-    const char *name;
-    size_t offset;
-    void *addressLow = nullptr;
-    void *addressHigh = nullptr;
-
-    TrackingException(size_t stackPos, const char *name, size_t offset)
-    :   stackPos(stackPos),
-        name(name),
-        offset(offset)
-    { }
+// suppressions //////////////////////////////////////////////////////////////
+
+namespace {
+
+const int ANY_FRAME = -1;
+const int SHALLOW_FRAMES = 8;
+
+struct Suppression {
+    bool alloc;
+    std::string symbol;
+    size_t offset;          // (size_t) -1 for the whole symbol
+    std::string object;     // used when symbol is empty
+    int frame;              // stack position of the matching frame, or ANY_FRAME
 };
 
-static TrackingException allocEx[] = {
-    { 0, "_dl_allocate_tls", (size_t) -1 },
-    { 2, "GOMP_parallel", 0x26 },
-    { 2, "GOMP_parallel", 0x2a },
-    { 2, "GOMP_parallel", 0x3a },
-    { 2, "GOMP_parallel", 0x3d },
-    { 2, "GOMP_parallel", 0x41 },
-    { 1, "__tls_get_addr", 0x38 },
-    { 1, "__tls_get_addr", 0x3c },
-    { 0, "_IO_file_doallocate", (size_t) -1 },
+// built-in suppressions, resolved again every time a library is loaded
+struct BuiltinSuppression {
+    bool alloc;
+    int frame;
+    const char *symbol;
+    size_t offset;
+};
 
+const BuiltinSuppression builtinSuppressions[] = {
+    { true, 0, "_dl_allocate_tls", (size_t) -1 },
+    { true, 2, "GOMP_parallel", 0x26 },
+    { true, 2, "GOMP_parallel", 0x2a },
+    { true, 2, "GOMP_parallel", 0x3a },
+    { true, 2, "GOMP_parallel", 0x3d },
+    { true, 2, "GOMP_parallel", 0x41 },
+    { true, 1, "__tls_get_addr", 0x38 },
+    { true, 1, "__tls_get_addr", 0x3c },
+    { true, 0, "_IO_file_doallocate", (size_t) -1 },
+
+    { false, 0, "_dl_deallocate_tls", (size_t) -1 },
+    { false, 0, "pthread_create", (size_t) -1 },
+    { false, 0, "_IO_setb", (size_t) -1 },
 };
-const size_t nAllocEx = sizeof(allocEx) / sizeof(TrackingException);
+const size_t nBuiltinSuppressions = sizeof(builtinSuppressions) / sizeof(BuiltinSuppression);
 
-static TrackingException deallocEx[] = {
-    { 0, "_dl_deallocate_tls", (size_t) -1 },
-    { 0, "_dl_deallocate_tls", (size_t) -1 },
-    { 0, "pthread_create", (size_t) -1 },
-    { 0, "_IO_setb", (size_t) -1 },
+// disjoint address range, suppressing the stack positions set in frames
+struct Segment {
+    void *low;
+    void *high;
+    uint64_t frames;
 };
-const size_t nDeallocEx = sizeof(deallocEx) / sizeof(TrackingException);
 
-bool Memory::_canTrackAlloc(const CallStack &callstack) {
-    auto s = callstack.stack();
+struct SuppressionTable {
+    Segment *segments = nullptr;
+    size_t size = 0;
+    int depth = 0;      // frames to check before capturing the full stack
+
+    inline bool match(void * const *stack, int from, int to) const {
+        for (int i = from; i < to; ++i) {
+            auto it = std::upper_bound(
+                segments,
+                segments + size,
+                stack[i],
+                [] (void *address, const Segment &segment) {
+                    return address < segment.low;
+                }
+            );
+            if (it == segments) continue;
+            --it;
 
-    for (size_t i = 0; i < nAllocEx; ++i) {
-        if (
-            s[allocEx[i].stackPos] >= allocEx[i].addressLow
-            && s[allocEx[i].stackPos] < allocEx[i].addressHigh
-        ) return false;
+            if (stack[i] < it->high && (it->frames & (1lu << std::min(i, 63))) != 0) return true;
+        }
+        return false;
     }
+};
 
-    return true;
+SuppressionTable allocTable;
+SuppressionTable deallocTable;
+
+std::vector<Suppression> & userSuppressions() {
+    static std::vector<Suppression> suppressions;
+    return suppressions;
 }
 
-bool Memory::_canTrackDealloc(const CallStack &callstack) {
-    auto s = callstack.stack();
+std::vector<void *> & loadedHandles() {
+    static std::vector<void *> handles = { RTLD_DEFAULT };
+    return handles;
+}
 
-    for (size_t i = 0; i < nDeallocEx; ++i) {
-        if (
-            s[deallocEx[i].stackPos] >= deallocEx[i].addressLow
-            && s[deallocEx[i].stackPos] < deallocEx[i].addressHigh
-        ) return false;
-    }
+struct Interval {
+    void *low;
+    void *high;
+    uint64_t frames;
+};
 
-    return true;
+void resolveSymbol(const Suppression &s, std::vector<Interval> &intervals) {
+    uint64_t frames = (s.frame == ANY_FRAME) ? (uint64_t) -1 : 1lu << s.frame;
+
+    for (auto handle : loadedHandles()) {
+        void *address = dlsym(handle, s.symbol.c_str());
+        if (address == nullptr) continue;
+
+        if (s.offset == (size_t) -1) {
+            Dl_info dli;
+            ElfW(Sym) *sym = nullptr;
+            if (! dladdr1(address, &dli, (void **) &sym, RTLD_DL_SYMENT) || sym == nullptr) continue;
+            intervals.push_back({ address, (char *) address + std::max((size_t) sym->st_size, (size_t) 1), frames });
+        }
+        else {
+            intervals.push_back({ (char *) address + s.offset, (char *) address + s.offset + 1, frames });
+        }
+    }
 }
 
-void Memory::reinitialize(void *handle) {
-    for (size_t i = 0; i < nAllocEx; ++i) {
-        if (allocEx[i].addressLow != nullptr) continue;
+void resolveObject(const Suppression &s, std::vector<Interval> &intervals) {
+    struct Query {
+        const Suppression *suppression;
+        std::vector<Interval> *intervals;
+    } query = { &s, &intervals };
 
-        allocEx[i].addressLow = dlsym(handle, allocEx[i].name);
+    dl_iterate_phdr(
+        [] (struct dl_phdr_info *info, size_t, void *data) {
+            auto q = (Query *) data;
 
-        if (allocEx[i].addressLow == nullptr) continue;
+            const char *name = strrchr(info->dlpi_name, '/');
+            name = (name == nullptr) ? info->dlpi_name : name + 1;
+            if (strncmp(name, q->suppression->object.c_str(), q->suppression->object.size()) != 0) return 0;
 
-        if (allocEx[i].offset == (size_t) -1) {
-            Dl_info dli;
-            ElfW(Sym) *sym;
-            dladdr1(allocEx[i].addressLow, &dli, (void **) &sym, RTLD_DL_SYMENT);
-            allocEx[i].addressHigh = (char *) allocEx[i].addressLow + sym->st_size;
+            uint64_t frames = (q->suppression->frame == ANY_FRAME)
+                ? (uint64_t) -1
+                : 1lu << q->suppression->frame;
+
+            for (int i = 0; i < info->dlpi_phnum; ++i) {
+                const auto &phdr = info->dlpi_phdr[i];
+                if (phdr.p_type != PT_LOAD) continue;
+
+                char *low = (char *) info->dlpi_addr + phdr.p_vaddr;
+                q->intervals->push_back({ low, low + phdr.p_memsz, frames });
+            }
+            return 0;
+        },
+        &query
+    );
+}
+
+// flattens possibly overlapping intervals into sorted, disjoint segments
+void buildTable(std::vector<Interval> &intervals, int depth, SuppressionTable &table) {
+    std::vector<void *> bounds;
+    for (const auto &interval : intervals) {
+        bounds.push_back(interval.low);
+        bounds.push_back(interval.high);
+    }
+    std::sort(bounds.begin(), bounds.end());
+    bounds.erase(std::unique(bounds.begin(), bounds.end()), bounds.end());
+
+    std::vector<Segment> segments;
+    for (size_t i = 0; i + 1 < bounds.size(); ++i) {
+        uint64_t frames = 0;
+        for (const auto &interval : intervals) {
+            if (interval.low <= bounds[i] && bounds[i] < interval.high) frames |= interval.frames;
+        }
+        if (frames == 0) continue;
+
+        if (! segments.empty() && segments.back().high == bounds[i] && segments.back().frames == frames) {
+            segments.back().high = bounds[i + 1];
         }
         else {
-            allocEx[i].addressLow = (char *) allocEx[i].addressLow + allocEx[i].offset;
-            allocEx[i].addressHigh = (char *) allocEx[i].addressLow + 1;
+            segments.push_back({ bounds[i], bounds[i + 1], frames });
         }
     }
 
-    for (size_t i = 0; i < nDeallocEx; ++i) {
-        if (deallocEx[i].addressLow != nullptr) continue;
+    libc().free(table.segments);
+    table.segments = (Segment *) libc().malloc(std::max(segments.size(), (size_t) 1) * sizeof(Segment));
+    std::copy(segments.begin(), segments.end(), table.segments);
+    table.size = segments.size();
+    table.depth = depth;
+}
 
-        deallocEx[i].addressLow = dlsym(handle, deallocEx[i].name);
+}
 
-        if (deallocEx[i].addressLow == nullptr) continue;
+bool Memory::_traceAlloc(CallStack &callstack, int skip) {
+    ++skip;
 
-        if (deallocEx[i].offset == (size_t) -1) {
-            Dl_info dli;
-            ElfW(Sym) *sym;
-            dladdr1(deallocEx[i].addressLow, &dli, (void **) &sym, RTLD_DL_SYMENT);
-            deallocEx[i].addressHigh = (char *) deallocEx[i].addressLow + sym->st_size;
+    void *frames[SHALLOW_FRAMES];
+    int nFrames = CallStack::shallowTrace(frames, allocTable.depth, skip);
+    if (allocTable.match(frames, 0, nFrames)) return false;
+
+    callstack = CallStack::trace(skip);
+    return ! allocTable.match(callstack.stack(), nFrames, callstack.size());
+}
+
+bool Memory::_canTrackDealloc(const CallStack &callstack) {
+    return ! deallocTable.match(callstack.stack(), 0, callstack.size());
+}
+
+void Memory::reinitialize(void *handle) {
+    auto &handles = loadedHandles();
+    if (std::find(handles.begin(), handles.end(), handle) == handles.end()) handles.push_back(handle);
+
+    std::vector<Suppression> suppressions;
+    for (size_t i = 0; i < nBuiltinSuppressions; ++i) {
+        const auto &s = builtinSuppressions[i];
+        suppressions.push_back({ s.alloc, s.symbol, s.offset, "", s.frame });
+    }
+    suppressions.insert(suppressions.end(), userSuppressions().begin(), userSuppressions().end());
+
+    std::vector<Interval> allocIntervals, deallocIntervals;
+    int allocDepth = 0, deallocDepth = 0;
+
+    for (const auto &s : suppressions) {
+        auto &intervals = s.alloc ? allocIntervals : deallocIntervals;
+        auto &depth = s.alloc ? allocDepth : deallocDepth;
+
+        if (s.symbol.empty()) resolveObject(s, intervals);
+        else resolveSymbol(s, intervals);
+
+        depth = std::max(depth, (s.frame == ANY_FRAME) ? SHALLOW_FRAMES : s.frame + 1);
+    }
+
+    buildTable(allocIntervals, allocDepth, allocTable);
+    buildTable(deallocIntervals, deallocDepth, deallocTable);
+}
+
+bool Memory::loadSuppressions(const std::string &path, std::string &error) {
+    std::ifstream file(path);
+    if (! file.is_open()) {
+        error = "could not open suppressions file '" + path + "'";
+        return false;
+    }
+
+    // nothing is loaded unless the whole file is valid
+    std::vector<Suppression> loaded;
+
+    std::string line;
+    for (size_t lineNumber = 1; std::getline(file, line); ++lineNumber) {
+        auto comment = line.find('#');
+        if (comment != std::string::npos) line.resize(comment);
+
+        std::stringstream tokens(line);
+        std::string kind, target, frame;
+        tokens >> kind >> target >> frame;
+        if (kind.empty()) continue;
+
+        Suppression s = { true, "", (size_t) -1, "", ANY_FRAME };
+        bool valid = (kind == "alloc" || kind == "dealloc") && ! target.empty();
+        s.alloc = (kind == "alloc");
+
+        if (! frame.empty() && frame != "*") {
+            char *end;
+            long value = strtol(frame.c_str(), &end, 10);
+            valid = valid && *end == '\0' && value >= 0 && value < SHALLOW_FRAMES;
+            s.frame = value;
+        }
+
+        if (target.compare(0, 7, "object:") == 0) {
+            s.object = target.substr(7);
+            valid = valid && ! s.object.empty();
         }
         else {
-            deallocEx[i].addressLow = (char *) deallocEx[i].addressLow + deallocEx[i].offset;
-            deallocEx[i].addressHigh = (char *) deallocEx[i].addressLow + 1;
+            auto plus = target.rfind('+');
+            if (plus != std::string::npos) {
+                char *end;
+                s.offset = strtoul(target.c_str() + plus + 1, &end, 0);
+                valid = valid && plus > 0 && plus + 1 < target.size() && *end == '\0';
+                target.resize(plus);
+            }
+            s.symbol = target;
         }
+
+        std::string extra;
+        if (! valid || (tokens >> extra)) {
+            error = path + ":" + std::to_string(lineNumber) + ": invalid suppression";
+            return false;
+        }
+
+        loaded.push_back(s);
     }
+
+    userSuppressions().insert(userSuppressions().end(), loaded.begin(), loaded.end());
+    reinitialize();
+    return true;
+}
+
+AllocationBudget::AllocationBudget(size_t maxBlocks, size_t maxBytes)
+: _maxBlocks(maxBlocks),
+  _maxBytes(maxBytes),
+  _parent(Memory::_budget)
+{
+    Memory::_budget = this;
+}
+
+AllocationBudget::~AllocationBudget() {
+    Memory::_budget = _parent;
 }
 
 Memory::Memory() {
@@ -124,37 +321,144 @@ Memory::Memory() {
     reinitialize();
 }
 
+Memory::Site * Memory::_site(CallStack &&callstack) {
+    auto it = _sites.find(callstack);
+    if (it == _sites.end()) {
+        it = _sites.insert({ std::move(callstack), Site() }).first;
+        it->second.callstack = &it->first;
+    }
+    return &it->second;
+}
+
+Memory::Allocation Memory::_acquire(Site *site, size_t size, bool pooled) {
+    _touch(site);
+    site->size += size;
+    ++site->count;
+    site->totalSize += size;
+    ++site->totalCount;
+
+    if (pooled) {
+        _poolAllocateSize += size;
+        ++_poolAllocateCount;
+    }
+    else {
+        _allocateSize += size;
+        ++_allocateCount;
+    }
+
+    if (_profile.histograms) {
+        site->sizes.add(size);
+        _sizes.add(size);
+    }
+
+    return {
+        size,
+        site,
+        _profile.histograms ? _now() : 0,
+        ++_allocationIndex,
+        _profile.crossThreadFrees ? _threadIndex() : 0
+    };
+}
+
+void Memory::_release(const Allocation &alloc, bool pooled) {
+    _touch(alloc.site);
+    alloc.site->size -= alloc.size;
+    --alloc.site->count;
+
+    if (pooled) {
+        _poolFreeSize += alloc.size;
+        ++_poolFreeCount;
+    }
+    else {
+        _freeSize += alloc.size;
+        ++_freeCount;
+    }
+
+    // blocks allocated before the option was enabled have no time or thread
+    if (_profile.histograms && alloc.time != 0) {
+        uint64_t lifetime = _now() - alloc.time;
+        uint64_t lifetimeAllocations = _allocationIndex - alloc.index;
+
+        alloc.site->lifetimes.add(lifetime);
+        alloc.site->lifetimeAllocations.add(lifetimeAllocations);
+        _lifetimes.add(lifetime);
+        _lifetimeAllocations.add(lifetimeAllocations);
+    }
+
+    if (_profile.crossThreadFrees && alloc.thread != 0) {
+        uint32_t thread = _threadIndex();
+        auto &pair = _threadPairs[((uint64_t) alloc.thread << 32) | thread];
+        pair.size += alloc.size;
+        ++pair.count;
+
+        if (thread != alloc.thread) {
+            alloc.site->crossThreadSize += alloc.size;
+            ++alloc.site->crossThreadCount;
+        }
+    }
+}
+
 void Memory::track(void *ptr, size_t size) {
     if (! _enter()) return;
 
-    auto callstack = CallStack::trace(2);
-    if (_canTrackAlloc(callstack)) {
+    bool exceeded = false;
+    AllocationBudget *overBudget = nullptr;
+
+    CallStack callstack;
+    if (_traceAlloc(callstack, 2)) {
+        size_t usable = _profile.overhead ? malloc_usable_size(ptr) : 0;
+
         _mtx.lock();
-        _blocks.insert({ ptr, { size, std::move(callstack) } });
-        _allocateSize += size;
-        ++_allocateCount;
-        _maxAllocate = std::max(_maxAllocate, _allocateSize - _freeSize);
-        _maxAllocateCount = std::max(_maxAllocateCount, _allocateCount - _freeCount);
+        _blocks.insert({ ptr, _acquire(_site(std::move(callstack)), size) });
+        if (_profile.overhead) {
+            auto &sizeClass = _sizeClasses[Log2Histogram::bucket(size)];
+            ++sizeClass.count;
+            sizeClass.requested += size;
+            sizeClass.usable += usable;
+        }
+        _updateUsage();
+        exceeded = ! _withinLimits();
         _mtx.unlock();
+
+        overBudget = _charge(size);
     }
 
     _exit();
+
+    if (exceeded) _limitExceeded();
+    if (overBudget != nullptr) _budgetExceeded(overBudget);
 }
 
 void Memory::track_mapped(char *ptr, size_t size) {
     if (! _enter()) return;
 
-    auto callstack = CallStack::trace(2);
-    if (_canTrackAlloc(callstack)) {
+    bool exceeded = false;
+    AllocationBudget *overBudget = nullptr;
+
+    CallStack callstack;
+    if (_traceAlloc(callstack, 2)) {
         _mtx.lock();
-        _orderedBlocks.insert({ ptr + size - 1, { size, std::move(callstack) } });
+        auto site = _site(std::move(callstack));
+        _touch(site);
+        _mappedBlocks.insert(ptr, size, { site, ++_allocationIndex });
+        site->size += size;
+        site->totalSize += size;
+        if (_profile.histograms) {
+            site->sizes.add(size);
+            _sizes.add(size);
+        }
         _allocateSize += size;
-        _maxAllocate = std::max(_maxAllocate, _allocateSize - _freeSize);
-        _maxAllocateCount = std::max(_maxAllocateCount, _allocateCount - _freeCount);
+        _updateUsage();
+        exceeded = ! _withinLimits();
         _mtx.unlock();
+
+        overBudget = _charge(size);
     }
 
     _exit();
+
+    if (exceeded) _limitExceeded();
+    if (overBudget != nullptr) _budgetExceeded(overBudget);
 }
 
 void Memory::retrack(void *oldPtr, void *newPtr, size_t newSize) {
@@ -183,77 +487,37 @@ void Memory::retrack(void *oldPtr, void *newPtr, size_t newSize) {
         return;
     }
 
-    auto alloc = std::move(it->second);
+    auto alloc = it->second;
     size_t oldSize = alloc.size;
     alloc.size = newSize;
     _blocks.erase(it);
-    _blocks.insert({ newPtr, std::move(alloc) });
+    _blocks.insert({ newPtr, alloc });
+    _touch(alloc.site);
+    alloc.site->size += newSize - oldSize;
+    alloc.site->totalSize += newSize - oldSize;
     _allocateSize += newSize - oldSize;
-    _maxAllocate = std::max(_maxAllocate, _allocateSize - _freeSize);
-    _maxAllocateCount = std::max(_maxAllocateCount, _allocateCount - _freeCount);
+    _updateUsage();
+
+    bool exceeded = ! _withinLimits();
 
     _mtx.unlock();
+
+    // a block that does not grow is not a new allocation
+    auto overBudget = newSize > oldSize ? _charge(newSize - oldSize) : nullptr;
+
     _exit();
+
+    if (exceeded) _limitExceeded();
+    if (overBudget != nullptr) _budgetExceeded(overBudget);
 }
 
 void Memory::retrack_mapped(char *oldPtr, size_t oldSize, char *newPtr, size_t newSize) {
     if (! _enter()) return;
     _mtx.lock();
 
-    while (oldSize > 0) {
-        auto it = _orderedBlocks.lower_bound(oldPtr);
-
-        if (it == _orderedBlocks.end()) break;
-
-        auto p = it->first - it->second.size + 1;
-
-        if (p > oldPtr) break;
+    size_t unmatched = _unmap(oldPtr, oldSize);
 
-        auto alloc = std::move(it->second);
-
-        _orderedBlocks.erase(it);
-
-        if (oldPtr == p) {
-            if (alloc.size > oldSize) {
-                p += oldSize;
-                alloc.size -= oldSize;
-                _orderedBlocks.insert({ p + alloc.size - 1, std::move(alloc) });
-
-                _freeSize += oldSize;
-                oldSize = 0;
-            }
-            else {
-                _freeSize += alloc.size;
-                oldPtr += alloc.size;
-                oldSize -= alloc.size;
-            }
-        }
-        else {
-            size_t off = oldPtr - p;
-            size_t rem = alloc.size - off;
-
-            if (rem > oldSize) {
-                alloc.size = off;
-                _orderedBlocks.insert({ p + alloc.size - 1, alloc});
-
-                p = oldPtr + oldSize;
-                alloc.size = rem - oldSize;
-                _orderedBlocks.insert({ p + alloc.size - 1, std::move(alloc) });
-
-                _freeSize += oldSize;
-                oldSize = 0;
-            }
-            else {
-                _freeSize += rem;
-                oldPtr += rem;
-                oldSize -= rem;
-                alloc.size -= rem;
-                _orderedBlocks.insert({ p + alloc.size - 1, std::move(alloc) });
-            }
-        }
-    }
-
-    if (oldSize > 0) {
+    if (unmatched > 0) {
         _mtx.unlock();
         bool error = _canTrackDealloc(CallStack::trace(2));
         _exit();
@@ -262,7 +526,7 @@ void Memory::retrack_mapped(char *oldPtr, size_t oldSize, char *newPtr, size_t n
             sandbox().exitAll();
 
             char buf[64];
-            snprintf(buf, sizeof(buf), "no valid memory block at %p", oldPtr);
+            snprintf(buf, sizeof(buf), "no valid memory block at %p", oldPtr + oldSize - unmatched);
 
             throw SandboxFatalException(
                 FatalError::MEMORY_BLOCK_DOES_NOT_EXIST,
@@ -274,16 +538,67 @@ void Memory::retrack_mapped(char *oldPtr, size_t oldSize, char *newPtr, size_t n
         return;
     }
 
-    auto callstack = CallStack::trace(2);
-    if (_canTrackAlloc(callstack)) {
-        _orderedBlocks.insert({ newPtr + newSize - 1, { newSize, std::move(callstack) } });
+    AllocationBudget *overBudget = nullptr;
+
+    CallStack callstack;
+    if (_traceAlloc(callstack, 2)) {
+        auto site = _site(std::move(callstack));
+        _touch(site);
+        _mappedBlocks.insert(newPtr, newSize, { site, ++_allocationIndex });
+        site->size += newSize;
+        site->totalSize += newSize;
+        if (_profile.histograms) {
+            site->sizes.add(newSize);
+            _sizes.add(newSize);
+        }
         _allocateSize += newSize;
-        _maxAllocate = std::max(_maxAllocate, _allocateSize - _freeSize);
-        _maxAllocateCount = std::max(_maxAllocateCount, _allocateCount - _freeCount);
+
+        if (newSize > oldSize) overBudget = _charge(newSize - oldSize);
     }
 
+    _updateUsage();
+
+    bool exceeded = ! _withinLimits();
+
     _mtx.unlock();
     _exit();
+
+    if (exceeded) _limitExceeded();
+    if (overBudget != nullptr) _budgetExceeded(overBudget);
+}
+
+void Memory::_limitExceeded() {
+    // stop tracking first, since reporting the error allocates memory
+    sandbox().exitAll();
+
+    std::string msg;
+    if (_allocateSize - _freeSize > _bytesLimit) {
+        msg = "exceeded memory limit of " + formatSize(_bytesLimit);
+    }
+    else {
+        msg = "exceeded memory limit of " + std::to_string(_blocksLimit) + " blocks";
+    }
+
+    sandbox().fatalError(
+        SandboxFatalException(FatalError::MEMORY_LIMIT_EXCEEDED, msg, 3)
+    );
+}
+
+void Memory::_budgetExceeded(const AllocationBudget *budget) {
+    sandbox().exitAll();
+
+    std::string msg;
+    if (budget->_maxBlocks == 0) {
+        msg = "allocated memory inside a no-allocation region";
+    }
+    else {
+        msg = "exceeded allocation budget of " + std::to_string(budget->_maxBlocks)
+            + " block(s) and " + formatSize(budget->_maxBytes);
+    }
+
+    sandbox().fatalError(
+        SandboxFatalException(FatalError::ALLOCATION_BUDGET_EXCEEDED, msg, 3)
+    );
 }
 
 void Memory::remove(void *ptr) {
@@ -312,72 +627,90 @@ void Memory::remove(void *ptr) {
         return;
     }
 
-    _freeSize += it->second.size;
-    ++_freeCount;
+    _release(it->second);
     _blocks.erase(it);
+    _updateUsage();
 
     _mtx.unlock();
     _exit();
 }
 
+size_t Memory::_unmap(char *ptr, size_t size) {
+    return _mappedBlocks.remove(ptr, size, [this] (const Mapping &mapping, size_t bytes) {
+        _touch(mapping.site);
+        mapping.site->size -= bytes;
+        _freeSize += bytes;
+    });
+}
+
 void Memory::remove_mapped(char *ptr, size_t size) {
     if (! _enter()) return;
     _mtx.lock();
 
-    while (size > 0) {
-        auto it = _orderedBlocks.lower_bound(ptr);
+    size_t unmatched = _unmap(ptr, size);
+
+    if (unmatched > 0) {
+        _mtx.unlock();
+        bool error = _canTrackDealloc(CallStack::trace(2));
+        _exit();
 
-        if (it == _orderedBlocks.end()) break;
+        if (error) {
+            sandbox().exitAll();
 
-        auto p = it->first - it->second.size + 1;
+            char buf[64];
+            snprintf(buf, sizeof(buf), "no valid memory block at %p", ptr + size - unmatched);
 
-        if (p > ptr) break;
+            throw SandboxFatalException(
+                FatalError::MEMORY_BLOCK_DOES_NOT_EXIST,
+                buf,
+                2
+            );
+        }
 
-        auto alloc = std::move(it->second);
+        return;
+    }
 
-        _orderedBlocks.erase(it);
+    _updateUsage();
 
-        if (ptr == p) {
-            if (alloc.size > size) {
-                p += size;
-                alloc.size -= size;
-                _orderedBlocks.insert({ p + alloc.size - 1, std::move(alloc) });
+    _mtx.unlock();
+    _exit();
+}
 
-                _freeSize += size;
-                size = 0;
-            }
-            else {
-                _freeSize += alloc.size;
-                ptr += alloc.size;
-                size -= alloc.size;
-            }
-        }
-        else {
-            size_t off = ptr - p;
-            size_t rem = alloc.size - off;
+void Memory::track_pooled(const void *pool, void *ptr, size_t size) {
+    if (! _enter()) return;
 
-            if (rem > size) {
-                alloc.size = off;
-                _orderedBlocks.insert({ p + alloc.size - 1, alloc});
+    AllocationBudget *overBudget = nullptr;
 
-                p = ptr + size;
-                alloc.size = rem - size;
-                _orderedBlocks.insert({ p + alloc.size - 1, std::move(alloc) });
+    CallStack callstack;
+    if (_traceAlloc(callstack, 2)) {
+        _mtx.lock();
+        auto &p = _pools[pool];
+        p.blocks[ptr] = _acquire(_site(std::move(callstack)), size, true);
+        p.size += size;
+        ++p.count;
+        p.totalSize += size;
+        ++p.totalCount;
+        p.maxSize = std::max(p.maxSize, p.size);
+        _mtx.unlock();
 
-                _freeSize += size;
-                size = 0;
-            }
-            else {
-                _freeSize += rem;
-                ptr += rem;
-                size -= rem;
-                alloc.size -= rem;
-                _orderedBlocks.insert({ p + alloc.size - 1, std::move(alloc) });
-            }
-        }
+        // the bytes were charged when the pool got its memory
+        overBudget = _charge(0);
     }
 
-    if (size > 0) {
+    _exit();
+
+    if (overBudget != nullptr) _budgetExceeded(overBudget);
+}
+
+void Memory::remove_pooled(const void *pool, void *ptr) {
+    if (! _enter()) return;
+    _mtx.lock();
+
+    // frees from unknown pools are reported like unknown blocks, without
+    // creating the pool
+    auto p = _pools.find(pool);
+    std::unordered_map<void *, Allocation>::iterator it;
+    if (p == _pools.end() || (it = p->second.blocks.find(ptr)) == p->second.blocks.end()) {
         _mtx.unlock();
         bool error = _canTrackDealloc(CallStack::trace(2));
         _exit();
@@ -386,7 +719,7 @@ void Memory::remove_mapped(char *ptr, size_t size) {
             sandbox().exitAll();
 
             char buf[64];
-            snprintf(buf, sizeof(buf), "no valid memory block at %p", ptr);
+            snprintf(buf, sizeof(buf), "no valid memory block at %p in pool %p", ptr, pool);
 
             throw SandboxFatalException(
                 FatalError::MEMORY_BLOCK_DOES_NOT_EXIST,
@@ -398,10 +731,41 @@ void Memory::remove_mapped(char *ptr, size_t size) {
         return;
     }
 
+    _release(it->second, true);
+    p->second.size -= it->second.size;
+    --p->second.count;
+    p->second.blocks.erase(it);
+
+    _mtx.unlock();
+    _exit();
+}
+
+void Memory::reset_pool(const void *pool) {
+    if (! _enter()) return;
+    _mtx.lock();
+
+    auto p = _pools.find(pool);
+    if (p != _pools.end()) {
+        for (const auto &block : p->second.blocks) _release(block.second, true);
+        p->second.blocks.clear();
+        p->second.size = 0;
+        p->second.count = 0;
+    }
+
     _mtx.unlock();
     _exit();
 }
 
+void Memory::name_pool(const void *pool, const char *name) {
+    lock();
+    _mtx.lock();
+
+    _pools[pool].name = name;
+
+    _mtx.unlock();
+    unlock();
+}
+
 void Memory::clear() {
     _enter();
     _mtx.lock();
@@ -413,32 +777,723 @@ void Memory::clear() {
     }
     _blocks.clear();
 
-    for (const auto &block : _orderedBlocks) {
-        _freeSize += block.second.size;
-        libc().munmap(block.first - block.second.size + 1, block.second.size);
+    _mappedBlocks.forEach([this] (char *start, size_t size, const Mapping &) {
+        _freeSize += size;
+        libc().munmap(start, size);
+    });
+    _mappedBlocks.clear();
+
+    // pooled blocks live in memory owned by the pool
+    for (auto &pool : _pools) {
+        _poolFreeSize += pool.second.size;
+        _poolFreeCount += pool.second.count;
+        pool.second.blocks.clear();
+        pool.second.size = 0;
+        pool.second.count = 0;
+    }
+
+    for (auto &site : _sites) {
+        site.second.size = 0;
+        site.second.count = 0;
     }
-    _orderedBlocks.clear();
 
     _mtx.unlock();
     _exit();
 }
 
+// resets VmHWM, see proc(5)
+static bool resetPeakResidentSize() {
+    int fd = open("/proc/self/clear_refs", O_WRONLY);
+    if (fd == -1) return false;
+
+    bool ok = write(fd, "5", 1) == 1;
+    close(fd);
+    return ok;
+}
+
+// reads a size field of /proc/self/status, e.g. "VmHWM: %zu kB"
+static size_t residentSize(const char *format) {
+    FILE *f = fopen("/proc/self/status", "r");
+    if (f == nullptr) return 0;
+
+    char line[256];
+    size_t kb = 0;
+
+    while (fgets(line, sizeof(line), f) != nullptr) {
+        if (sscanf(line, format, &kb) == 1) break;
+    }
+
+    fclose(f);
+    return kb * 1024;
+}
+
+void Memory::resetProfile() {
+    lock();
+    _mtx.lock();
+
+    for (auto &site : _sites) {
+        site.second.totalSize = site.second.size;
+        site.second.totalCount = site.second.count;
+        site.second.sizes.clear();
+        site.second.lifetimes.clear();
+        site.second.lifetimeAllocations.clear();
+        site.second.crossThreadSize = 0;
+        site.second.crossThreadCount = 0;
+    }
+
+    _threadPairs.clear();
+    _sizes.clear();
+    _lifetimes.clear();
+    _lifetimeAllocations.clear();
+    memset(_sizeClasses, 0, sizeof(_sizeClasses));
+
+    // only the overhead report reads VmHWM, which costs a write to clear_refs
+    if (_profile.overhead) {
+        resetPeakResidentSize();
+        _baselineResident = residentSize("VmRSS: %zu kB");
+        _baselineLive = _allocateSize - _freeSize;
+    }
+
+    for (auto &pool : _pools) {
+        pool.second.totalSize = pool.second.size;
+        pool.second.totalCount = pool.second.count;
+        pool.second.maxSize = pool.second.size;
+    }
+
+    _recordTimeline = _profile.timeline;
+    _startTime = std::chrono::steady_clock::now();
+    _timelineInterval = _TIMELINE_INTERVAL;
+    _timelineLength = 0;
+    _currentSample = { 0, _allocateSize - _freeSize, _allocateCount - _freeCount };
+
+    _peakStamp = ++_stamp;
+    _peakTime = 0;
+    _peakCount = _currentSample.count;
+
+    _mtx.unlock();
+    unlock();
+}
+
+void Memory::stopTimeline() {
+    lock();
+    _mtx.lock();
+
+    if (_recordTimeline) {
+        _pushSample();
+        _recordTimeline = false;
+    }
+
+    if (_profile.overhead) _peakResident = residentSize("VmHWM: %zu kB");
+
+    _mtx.unlock();
+    unlock();
+}
+
+void Memory::_updateUsage() {
+    size_t size = _allocateSize - _freeSize;
+    size_t count = _allocateCount - _freeCount;
+
+    _maxAllocateCount = std::max(_maxAllocateCount, count);
+
+    if (! _recordTimeline) {
+        _maxAllocate = std::max(_maxAllocate, size);
+        return;
+    }
+
+    uint64_t time = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - _startTime
+    ).count();
+
+    if (size > _maxAllocate) {
+        _maxAllocate = size;
+        _peakStamp = ++_stamp;
+        _peakTime = time;
+        _peakCount = count;
+    }
+
+    if (time >= _currentSample.time + _timelineInterval) {
+        _pushSample();
+        _currentSample = { time - time % _timelineInterval, size, count };
+    }
+    else {
+        _currentSample.size = std::max(_currentSample.size, size);
+        _currentSample.count = std::max(_currentSample.count, count);
+    }
+}
+
+void Memory::_pushSample() {
+    // downsample by merging adjacent samples, keeping the larger of the two
+    if (_timelineLength == _TIMELINE_LENGTH) {
+        for (size_t i = 0; i < _TIMELINE_LENGTH / 2; ++i) {
+            const auto &a = _timeline[2 * i];
+            const auto &b = _timeline[2 * i + 1];
+            _timeline[i] = {
+                a.time,
+                std::max(a.size, b.size),
+                std::max(a.count, b.count)
+            };
+        }
+        _timelineLength = _TIMELINE_LENGTH / 2;
+        _timelineInterval *= 2;
+    }
+
+    _timeline[_timelineLength++] = _currentSample;
+}
+
+// functions whose frames are attributed to the allocation hooks rather than to
+// the code that requested the memory
+static void * frameworkFunctions[] = {
+    (void *) (void *(*)(size_t)) &::operator new,
+    (void *) (void *(*)(size_t)) &::operator new[],
+    (void *) (void *(*)(size_t, const std::nothrow_t &)) &::operator new,
+    (void *) (void *(*)(size_t, const std::nothrow_t &)) &::operator new[],
+#if (__cplusplus >= 201703L)
+    (void *) (void *(*)(size_t, std::align_val_t)) &::operator new,
+    (void *) (void *(*)(size_t, std::align_val_t)) &::operator new[],
+    (void *) (void *(*)(size_t, std::align_val_t, const std::nothrow_t &)) &::operator new,
+    (void *) (void *(*)(size_t, std::align_val_t, const std::nothrow_t &)) &::operator new[],
+#endif
+};
+const size_t nFrameworkFunctions = sizeof(frameworkFunctions) / sizeof(void *);
+
+static int firstUserFrame(const CallStack &callstack) {
+    auto s = callstack.stack();
+
+    for (int i = 0; i < callstack.size(); ++i) {
+        Dl_info info;
+        if (! dladdr(s[i], &info)) return i;
+
+        bool framework = false;
+        for (size_t j = 0; j < nFrameworkFunctions; ++j) {
+            if (info.dli_saddr == frameworkFunctions[j]) {
+                framework = true;
+                break;
+            }
+        }
+        if (! framework) return i;
+    }
+
+    return 0;
+}
+
+static std::string objectName(const CallStack &callstack) {
+    if (callstack.size() == 0) return "[unknown]";
+
+    Dl_info info;
+    if (! dladdr(callstack.stack()[firstUserFrame(callstack)], &info)) return "[unknown]";
+    return info.dli_fname;
+}
+
+std::vector<const Memory::Site *> Memory::_sortedSites(bool liveOnly) {
+    std::vector<const Site *> sites;
+
+    for (const auto &site : _sites) {
+        if (site.second.size > 0 || (! liveOnly && site.second.totalSize > 0)) {
+            sites.push_back(&site.second);
+        }
+    }
+
+    std::sort(
+        sites.begin(),
+        sites.end(),
+        [] (const Site *a, const Site *b) {
+            return a->size > b->size
+                || (a->size == b->size && a->totalSize > b->totalSize);
+        }
+    );
+
+    return sites;
+}
+
 std::string Memory::report() {
-    _enter();
+    lock();
     _mtx.lock();
 
     std::stringstream s;
 
-    for (const auto & block : _blocks) {
-        s << "\nBlock @ " << block.first << " allocated from:\n" << block.second.callstack.toString();
+    for (const auto &pool : _pools) {
+        if (pool.second.count == 0) continue;
+
+        s << "\n" << pool.second.count << " block(s), " << formatSize(pool.second.size)
+            << " allocated from pool " << _poolName(pool.first, pool.second);
     }
 
-    for (const auto & block : _orderedBlocks) {
-        s << "\nBlock @ " << (void *) (block.first - block.second.size + 1)
-            << " allocated from:\n" << block.second.callstack.toString();
+    // scoped, so that it is freed before unlocking
+    {
+        // mapped regions are not counted by their sites, and are reported as
+        // blocks, as in heap diffs
+        std::unordered_map<const Site *, size_t> regions;
+        _mappedBlocks.forEach([&regions] (char *, size_t, const Mapping &mapping) {
+            ++regions[mapping.site];
+        });
+
+        for (auto site : _sortedSites(true)) {
+            auto it = regions.find(site);
+            size_t count = site->count + ((it == regions.end()) ? 0 : it->second);
+
+            s << "\n" << count << " block(s), " << formatSize(site->size)
+                << " allocated from:\n" << site->callstack->toString();
+        }
     }
 
     _mtx.unlock();
-    _exit();
+    unlock();
     return s.str();
 }
+
+static void quantityReport(std::stringstream &s, const char *name, size_t size, size_t count) {
+    s << "\"" << name << "\": {";
+    s << "\n  \"size\": " << size;
+    s << ",\n  \"blocks\": " << count;
+    s << "\n}";
+}
+
+std::string Memory::profile(size_t topN) {
+    lock();
+    _mtx.lock();
+
+    std::stringstream s;
+
+    auto sites = _sortedSites(false);
+    std::map<std::string, Site> objects;
+
+    s << "\"sites\": [";
+    for (size_t i = 0; i < sites.size(); ++i) {
+        auto name = objectName(*sites[i]->callstack);
+
+        auto &object = objects[name];
+        object.size += sites[i]->size;
+        object.count += sites[i]->count;
+        object.totalSize += sites[i]->totalSize;
+        object.totalCount += sites[i]->totalCount;
+
+        if (i >= topN) continue;
+
+        std::stringstream ss;
+        ss << "\"object\": " << jsonify(name) << ",\n";
+        quantityReport(ss, "live", sites[i]->size, sites[i]->count);
+        ss << ",\n";
+        quantityReport(ss, "total", sites[i]->totalSize, sites[i]->totalCount);
+        ss << ",\n\"callstack\": " << jsonify(sites[i]->callstack->toString());
+
+        if (i > 0) s << ",";
+        s << "\n  {\n" << indent(ss.str(), 4) << "\n  }";
+    }
+    s << "\n]";
+
+    std::vector<std::pair<std::string, Site>> sortedObjects(objects.begin(), objects.end());
+    std::sort(
+        sortedObjects.begin(),
+        sortedObjects.end(),
+        [] (const std::pair<std::string, Site> &a, const std::pair<std::string, Site> &b) {
+            return a.second.size > b.second.size
+                || (a.second.size == b.second.size && a.second.totalSize > b.second.totalSize);
+        }
+    );
+
+    s << ",\n\"objects\": [";
+    for (size_t i = 0; i < sortedObjects.size() && i < topN; ++i) {
+        std::stringstream ss;
+        ss << "\"object\": " << jsonify(sortedObjects[i].first) << ",\n";
+        quantityReport(ss, "live", sortedObjects[i].second.size, sortedObjects[i].second.count);
+        ss << ",\n";
+        quantityReport(ss, "total", sortedObjects[i].second.totalSize, sortedObjects[i].second.totalCount);
+
+        if (i > 0) s << ",";
+        s << "\n  {\n" << indent(ss.str(), 4) << "\n  }";
+    }
+    s << "\n]";
+
+    _mtx.unlock();
+    unlock();
+    return s.str();
+}
+
+void Memory::exportProfile(std::ostream &out, bool live) {
+    lock();
+    _mtx.lock();
+
+    for (auto site : _sortedSites(live)) {
+        size_t value = live ? site->size : site->totalSize;
+        if (value == 0) continue;
+
+        auto s = site->callstack->stack();
+        int first = firstUserFrame(*site->callstack);
+
+        for (int i = site->callstack->size() - 1; i >= first; --i) {
+            auto name = CallStack::symbolName(s[i]);
+            std::replace(name.begin(), name.end(), ';', ':');
+            out << name << (i == first ? ' ' : ';');
+        }
+        out << value << "\n";
+    }
+
+    _mtx.unlock();
+    unlock();
+}
+
+std::string Memory::timeline(size_t topN) {
+    lock();
+    _mtx.lock();
+
+    std::stringstream s;
+
+    s << "\"timeline\": {";
+    s << "\n  \"intervalNs\": " << _timelineInterval;
+    s << ",\n  \"samples\": [";
+    for (size_t i = 0; i < _timelineLength; ++i) {
+        if (i > 0) s << ",";
+        s << "\n    [ " << _timeline[i].time
+            << ", " << _timeline[i].size
+            << ", " << _timeline[i].count << " ]";
+    }
+    s << "\n  ]";
+    s << "\n},\n";
+
+    std::vector<std::pair<size_t, const Site *>> sites;
+    for (const auto &site : _sites) {
+        size_t size = (site.second.stamp < _peakStamp) ? site.second.size : site.second.peakSize;
+        if (size > 0) sites.push_back({ size, &site.second });
+    }
+    std::sort(
+        sites.begin(),
+        sites.end(),
+        [] (const std::pair<size_t, const Site *> &a, const std::pair<size_t, const Site *> &b) {
+            return a.first > b.first;
+        }
+    );
+
+    s << "\"peak\": {";
+    s << "\n  \"timeNs\": " << _peakTime;
+    s << ",\n  \"size\": " << _maxAllocate;
+    s << ",\n  \"blocks\": " << _peakCount;
+    s << ",\n  \"sites\": [";
+    for (size_t i = 0; i < sites.size() && i < topN; ++i) {
+        auto site = sites[i].second;
+
+        std::stringstream ss;
+        ss << "\"size\": " << sites[i].first;
+        ss << ",\n\"blocks\": " << ((site->stamp < _peakStamp) ? site->count : site->peakCount);
+        ss << ",\n\"callstack\": " << jsonify(site->callstack->toString());
+
+        if (i > 0) s << ",";
+        s << "\n    {\n" << indent(ss.str(), 6) << "\n    }";
+    }
+    s << "\n  ]";
+    s << "\n}";
+
+    _mtx.unlock();
+    unlock();
+    return s.str();
+}
+
+std::string Memory::histograms(size_t topN) {
+    lock();
+    _mtx.lock();
+
+    std::stringstream s;
+
+    std::stringstream hs;
+    hs << "\"size\": " << _sizes.toString();
+    hs << ",\n\"lifetime\": " << _lifetimes.toString();
+    hs << ",\n\"lifetimeAllocations\": " << _lifetimeAllocations.toString();
+    s << "\"histograms\": {\n" << indent(hs.str(), 2) << "\n},\n";
+
+    // sites whose blocks are freed shortly after being allocated, many times over
+    std::vector<const Site *> sites;
+    for (const auto &site : _sites) {
+        if (
+            site.second.lifetimes.count() >= _POOL_MIN_FREES
+            && site.second.lifetimeAllocations.percentile(0.5) <= _POOL_MAX_LIFETIME
+        ) sites.push_back(&site.second);
+    }
+    std::sort(
+        sites.begin(),
+        sites.end(),
+        [] (const Site *a, const Site *b) {
+            return a->lifetimes.count() > b->lifetimes.count();
+        }
+    );
+
+    s << "\"poolCandidates\": [";
+    for (size_t i = 0; i < sites.size() && i < topN; ++i) {
+        auto site = sites[i];
+
+        std::stringstream ss;
+        ss << "\"blocks\": " << site->lifetimes.count();
+        ss << ",\n\"fixedSize\": " << ((site->sizes.spread() == 1) ? "true" : "false");
+        ss << ",\n\"medianSize\": " << site->sizes.percentile(0.5);
+        ss << ",\n\"medianLifetime\": " << formatDurationJSON(site->lifetimes.percentile(0.5));
+        ss << ",\n\"medianLifetimeAllocations\": " << site->lifetimeAllocations.percentile(0.5);
+        ss << ",\n\"size\": " << site->sizes.toString();
+        ss << ",\n\"lifetime\": " << site->lifetimes.toString();
+        ss << ",\n\"callstack\": " << jsonify(site->callstack->toString());
+
+        if (i > 0) s << ",";
+        s << "\n  {\n" << indent(ss.str(), 4) << "\n  }";
+    }
+    s << "\n]";
+
+    _mtx.unlock();
+    unlock();
+    return s.str();
+}
+
+HeapSnapshot Memory::heapSnapshot() {
+    HeapSnapshot snapshot;
+
+    _mtx.lock();
+    snapshot.index = _allocationIndex;
+    _mtx.unlock();
+
+    return snapshot;
+}
+
+void Memory::heapDiff(const HeapSnapshot &from, const HeapSnapshot &to, HeapDiff &diff) {
+    lock();
+    _mtx.lock();
+
+    diff._sites.clear();
+    diff._size = 0;
+    diff._blocks = 0;
+
+    // scoped, so that it is freed before unlocking
+    {
+        std::unordered_map<const Site *, HeapDiff::Site> sites;
+
+        for (const auto &block : _blocks) {
+            if (block.second.index <= from.index || block.second.index > to.index) continue;
+
+            auto &site = sites[block.second.site];
+            site.size += block.second.size;
+            ++site.blocks;
+        }
+
+        _mappedBlocks.forEach([&from, &to, &sites] (char *, size_t size, const Mapping &mapping) {
+            if (mapping.index <= from.index || mapping.index > to.index) return;
+
+            auto &site = sites[mapping.site];
+            site.size += size;
+            ++site.blocks;
+        });
+
+        for (const auto &pool : _pools) {
+            for (const auto &block : pool.second.blocks) {
+                if (block.second.index <= from.index || block.second.index > to.index) continue;
+
+                auto &site = sites[block.second.site];
+                site.size += block.second.size;
+                ++site.blocks;
+            }
+        }
+
+        for (auto &site : sites) {
+            site.second.callstack = site.first->callstack->toString();
+            diff._size += site.second.size;
+            diff._blocks += site.second.blocks;
+            diff._sites.push_back(std::move(site.second));
+        }
+    }
+
+    std::sort(
+        diff._sites.begin(),
+        diff._sites.end(),
+        [] (const HeapDiff::Site &a, const HeapDiff::Site &b) {
+            return a.size > b.size;
+        }
+    );
+
+    _mtx.unlock();
+    unlock();
+}
+
+void HeapDiff::_enter() const {
+    sandbox().lock();
+}
+
+void HeapDiff::_exit() const {
+    sandbox().unlock();
+}
+
+std::string HeapDiff::toString() const {
+    std::stringstream s;
+
+    s << _blocks << " block(s), " << formatSize(_size) << " still allocated";
+    for (const auto &site : _sites) {
+        s << "\n" << site.blocks << " block(s), " << formatSize(site.size)
+            << " allocated from:\n" << site.callstack;
+    }
+
+    return s.str();
+}
+
+std::string Memory::_poolName(const void *pool, const Pool &p) {
+    if (! p.name.empty()) return p.name;
+
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%p", pool);
+    return buf;
+}
+
+std::string Memory::pools() {
+    lock();
+    _mtx.lock();
+
+    std::stringstream s;
+
+    if (! _pools.empty()) {
+        s << "\"pools\": [";
+
+        size_t i = 0;
+        for (const auto &pool : _pools) {
+            if (pool.second.totalCount == 0) continue;
+
+            std::stringstream ss;
+            ss << "\"name\": " << jsonify(_poolName(pool.first, pool.second)) << ",\n";
+            quantityReport(ss, "live", pool.second.size, pool.second.count);
+            ss << ",\n";
+            quantityReport(ss, "total", pool.second.totalSize, pool.second.totalCount);
+            ss << ",\n\"max\": " << pool.second.maxSize;
+
+            if (i++ > 0) s << ",";
+            s << "\n  {\n" << indent(ss.str(), 4) << "\n  }";
+        }
+        s << "\n]";
+
+        if (i == 0) s.str("");
+    }
+
+    _mtx.unlock();
+    unlock();
+    return s.str();
+}
+
+std::string Memory::overhead() {
+    lock();
+    _mtx.lock();
+
+    std::stringstream s;
+    size_t requested = 0;
+    size_t usable = 0;
+
+    s << "\"sizeClasses\": [";
+    size_t n = 0;
+    for (size_t i = 0; i < Log2Histogram::BUCKETS; ++i) {
+        const auto &sizeClass = _sizeClasses[i];
+        if (sizeClass.count == 0) continue;
+
+        requested += sizeClass.requested;
+        usable += sizeClass.usable;
+
+        if (n++ > 0) s << ",";
+        s << "\n  { \"size\": " << Log2Histogram::lowerBound(i)
+            << ", \"blocks\": " << sizeClass.count
+            << ", \"requested\": " << sizeClass.requested
+            << ", \"usable\": " << sizeClass.usable << " }";
+    }
+    s << "\n]";
+
+    std::stringstream os;
+    os << "\"requested\": " << requested;
+    os << ",\n\"usable\": " << usable;
+    os << ",\n\"overhead\": " << ((requested > 0) ? (double) usable / requested : 1);
+    os << ",\n" << s.str();
+
+#if defined(__GLIBC__) && __GLIBC_PREREQ(2, 33)
+    auto info = mallinfo2();
+    os << ",\n\"mallinfo\": {";
+    os << "\n  \"arena\": " << info.arena;
+    os << ",\n  \"mmapped\": " << info.hblkhd;
+    os << ",\n  \"inUse\": " << info.uordblks;
+    os << ",\n  \"free\": " << info.fordblks;
+    os << ",\n  \"releasable\": " << info.keepcost;
+    os << "\n}";
+#endif
+
+    // growth since the profile was reset, which leaves out the binary, the
+    // libraries and the state of the framework
+    size_t rss = _peakResident > _baselineResident ? _peakResident - _baselineResident : 0;
+    size_t live = _maxAllocate > _baselineLive ? _maxAllocate - _baselineLive : 0;
+    os << ",\n\"peak\": {";
+    os << "\n  \"baselineRss\": " << _baselineResident;
+    os << ",\n  \"rss\": " << rss;
+    os << ",\n  \"live\": " << live;
+    if (live > 0) os << ",\n  \"ratio\": " << (double) rss / live;
+    os << "\n}";
+
+    _mtx.unlock();
+    unlock();
+    return "\"allocatorOverhead\": {\n" + indent(os.str(), 2) + "\n}";
+}
+
+std::string Memory::crossThreadFrees(size_t topN) {
+    lock();
+    _mtx.lock();
+
+    std::vector<std::pair<uint64_t, ThreadPair>> pairs(_threadPairs.begin(), _threadPairs.end());
+    std::sort(
+        pairs.begin(),
+        pairs.end(),
+        [] (const std::pair<uint64_t, ThreadPair> &a, const std::pair<uint64_t, ThreadPair> &b) {
+            return a.first < b.first;
+        }
+    );
+
+    size_t size = 0;
+    size_t count = 0;
+
+    std::stringstream ps;
+    ps << "\"threads\": [";
+    for (size_t i = 0; i < pairs.size(); ++i) {
+        uint32_t allocating = pairs[i].first >> 32;
+        uint32_t freeing = pairs[i].first & 0xffffffff;
+
+        if (allocating != freeing) {
+            size += pairs[i].second.size;
+            count += pairs[i].second.count;
+        }
+
+        if (i > 0) ps << ",";
+        ps << "\n  { \"allocating\": " << allocating
+            << ", \"freeing\": " << freeing
+            << ", \"size\": " << pairs[i].second.size
+            << ", \"blocks\": " << pairs[i].second.count << " }";
+    }
+    ps << "\n]";
+
+    std::vector<const Site *> sites;
+    for (const auto &site : _sites) {
+        if (site.second.crossThreadCount > 0) sites.push_back(&site.second);
+    }
+    std::sort(
+        sites.begin(),
+        sites.end(),
+        [] (const Site *a, const Site *b) {
+            return a->crossThreadSize > b->crossThreadSize;
+        }
+    );
+
+    std::stringstream ss;
+    ss << "\"sites\": [";
+    for (size_t i = 0; i < sites.size() && i < topN; ++i) {
+        std::stringstream s;
+        quantityReport(s, "crossThread", sites[i]->crossThreadSize, sites[i]->crossThreadCount);
+        s << ",\n";
+        quantityReport(s, "total", sites[i]->totalSize, sites[i]->totalCount);
+        s << ",\n\"callstack\": " << jsonify(sites[i]->callstack->toString());
+
+        if (i > 0) ss << ",";
+        ss << "\n  {\n" << indent(s.str(), 4) << "\n  }";
+    }
+    ss << "\n]";
+
+    std::stringstream s;
+    s << "\"size\": " << size;
+    s << ",\n\"blocks\": " << count;
+    s << ",\n" << ps.str();
+    s << ",\n" << ss.str();
+
+    _mtx.unlock();
+    unlock();
+    return "\"crossThreadFrees\": {\n" + indent(s.str(), 2) + "\n}";
+}
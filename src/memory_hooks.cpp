@@ -5,24 +5,46 @@
 
 #include <dtest_core/memory.h>
 #include <dtest_core/sandbox.h>
+#include <dtest_core/allocator.h>
 #include <malloc.h>
 #include <sys/mman.h>
 #include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
 
 using namespace dtest;
 
 namespace dtest {
     extern Memory *_mmgr_instance;
+    extern AllocatorBackend *_alloc_instance;
 }
 
 // malloc & friends
 
 static char _calloc_tmp[2048];      // for dlsym, while we find calloc
 
+// blocks of an allocator backend are resized within that backend
+static void * _reallocate(AllocatorBackend *backend, void *ptr, size_t size) {
+    void *newPtr = backend->allocate(size, 0);
+    if (newPtr && ptr) {
+        size_t oldSize = backend->usableSize(ptr);
+        memcpy(newPtr, ptr, (oldSize < size) ? oldSize : size);
+        backend->release(ptr);
+    }
+    return newPtr;
+}
+
+// the backends align by masking, which requires a power of two. Other
+// alignments are left to libc, which rejects or rounds them.
+static inline bool _backendAlignment(size_t alignment) {
+    return alignment != 0 && (alignment & (alignment - 1)) == 0;
+}
+
 void * malloc(size_t __size) {
     void *ptr;
 
-    ptr = libc().malloc(__size);
+    ptr = (_alloc_instance) ? _alloc_instance->allocate(__size, 0) : libc().malloc(__size);
     if (ptr && _mmgr_instance) _mmgr_instance->track(ptr, __size);
     return ptr;
 }
@@ -32,7 +54,16 @@ void * calloc(size_t __nmemb, size_t __size) {
 
     if (libc().calloc == nullptr) return _calloc_tmp;
 
-    ptr = libc().calloc(__nmemb, __size);
+    if (_alloc_instance) {
+        size_t size;
+        if (__builtin_mul_overflow(__nmemb, __size, &size)) return nullptr;
+
+        ptr = _alloc_instance->allocate(size, 0);
+        if (ptr) memset(ptr, 0, size);
+    }
+    else {
+        ptr = libc().calloc(__nmemb, __size);
+    }
     if (ptr && _mmgr_instance) _mmgr_instance->track(ptr, __nmemb * __size);
     return ptr;
 }
@@ -40,7 +71,9 @@ void * calloc(size_t __nmemb, size_t __size) {
 void * memalign(size_t __alignment, size_t __size) {
     void *ptr;
 
-    ptr = libc().memalign(__alignment, __size);
+    ptr = (_alloc_instance && _backendAlignment(__alignment))
+        ? _alloc_instance->allocate(__size, __alignment)
+        : libc().memalign(__alignment, __size);
     if (ptr && _mmgr_instance) _mmgr_instance->track(ptr, __size);
     return ptr;
 }
@@ -48,7 +81,13 @@ void * memalign(size_t __alignment, size_t __size) {
 int posix_memalign(void **__memptr, size_t __alignment, size_t __size) {
     int retval;
 
-    retval = libc().posix_memalign(__memptr, __alignment, __size);
+    if (_alloc_instance && _backendAlignment(__alignment)) {
+        *__memptr = _alloc_instance->allocate(__size, __alignment);
+        retval = (*__memptr) ? 0 : ENOMEM;
+    }
+    else {
+        retval = libc().posix_memalign(__memptr, __alignment, __size);
+    }
     if (*__memptr && _mmgr_instance) _mmgr_instance->track(*__memptr, __size);
     return retval;
 }
@@ -56,7 +95,7 @@ int posix_memalign(void **__memptr, size_t __alignment, size_t __size) {
 void * valloc(size_t __size) {
     void *ptr;
 
-    ptr = libc().valloc(__size);
+    ptr = (_alloc_instance) ? _alloc_instance->allocate(__size, getpagesize()) : libc().valloc(__size);
     if (ptr && _mmgr_instance) _mmgr_instance->track(ptr, __size);
     return ptr;
 }
@@ -64,7 +103,13 @@ void * valloc(size_t __size) {
 void * pvalloc(size_t __size) {
     void *ptr;
 
-    ptr = libc().pvalloc(__size);
+    if (_alloc_instance) {
+        size_t page = getpagesize();
+        ptr = _alloc_instance->allocate((__size + page - 1) & ~(page - 1), page);
+    }
+    else {
+        ptr = libc().pvalloc(__size);
+    }
     if (ptr && _mmgr_instance) _mmgr_instance->track(ptr, __size);
     return ptr;
 }
@@ -72,7 +117,9 @@ void * pvalloc(size_t __size) {
 void * aligned_alloc(size_t __alignment, size_t __size) {
     void *ptr;
 
-    ptr = libc().aligned_alloc(__alignment, __size);
+    ptr = (_alloc_instance && _backendAlignment(__alignment))
+        ? _alloc_instance->allocate(__size, __alignment)
+        : libc().aligned_alloc(__alignment, __size);
     if (ptr && _mmgr_instance) _mmgr_instance->track(ptr, __size);
     return ptr;
 }
@@ -80,7 +127,8 @@ void * aligned_alloc(size_t __alignment, size_t __size) {
 void * realloc(void *__ptr, size_t __size) {
     void *ptr;
 
-    ptr = libc().realloc(__ptr, __size);
+    auto backend = (__ptr) ? allocatorOf(__ptr) : _alloc_instance;
+    ptr = (backend) ? _reallocate(backend, __ptr, __size) : libc().realloc(__ptr, __size);
     if (__ptr) {
         if (ptr && _mmgr_instance) _mmgr_instance->retrack(__ptr, ptr, __size);
     }
@@ -93,7 +141,16 @@ void * realloc(void *__ptr, size_t __size) {
 void * reallocarray(void *__ptr, size_t __nmemb, size_t __size) throw() {
     void *ptr;
 
-    ptr = libc().reallocarray(__ptr, __nmemb, __size);
+    auto backend = (__ptr) ? allocatorOf(__ptr) : _alloc_instance;
+    if (backend) {
+        size_t size;
+        if (__builtin_mul_overflow(__nmemb, __size, &size)) return nullptr;
+
+        ptr = _reallocate(backend, __ptr, size);
+    }
+    else {
+        ptr = libc().reallocarray(__ptr, __nmemb, __size);
+    }
     if (__ptr) {
         if (ptr && _mmgr_instance) _mmgr_instance->retrack(__ptr, ptr, __nmemb * __size);
     }
@@ -108,7 +165,15 @@ void free(void *__ptr) {
     if (__ptr == _calloc_tmp) return;
 
     if (__ptr && _mmgr_instance) _mmgr_instance->remove(__ptr);
-    libc().free(__ptr);
+
+    auto backend = allocatorOf(__ptr);
+    if (backend) backend->release(__ptr);
+    else libc().free(__ptr);
+}
+
+size_t malloc_usable_size(void *__ptr) throw() {
+    auto backend = allocatorOf(__ptr);
+    return (backend) ? backend->usableSize(__ptr) : libc().malloc_usable_size(__ptr);
 }
 
 // mmap & friends
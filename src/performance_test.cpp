@@ -6,25 +6,603 @@
 #include <dtest_core/performance_test.h>
 #include <dtest_core/util.h>
 #include <dtest_core/time_of.h>
+#include <dtest_core/statistics.h>
+#include <algorithm>
+#include <chrono>
+#include <sys/mman.h>
 
 using namespace dtest;
 
+static inline uint64_t now() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()
+    ).count();
+}
+
+static void __attribute__((noinline)) emptyLoop(uint64_t n) {
+    for (uint64_t i = 0; i < n; ++i) doNotOptimize(i);
+}
+
+// instructions per iteration of a run, or its CPU time where the PMU is not
+// available
+static double workOf(const CounterValues &run, uint64_t iterations) {
+    return (double) run.value[
+        run.has(CounterValues::INSTRUCTIONS) ? CounterValues::INSTRUCTIONS : CounterValues::TASK_CLOCK
+    ] / iterations;
+}
+
+uint64_t PerformanceTest::_margin() const {
+    if (_performanceMargin != (uint64_t) -1) return _performanceMargin;
+    return (_microBody || _microBaseline) ? 0 : 1000000;
+}
+
+void PerformanceTest::_calibrate(const std::function<void(uint64_t)> &micro, Batch &batch) {
+    if (! micro) return;
+
+    // double the batch until a single batch takes the target duration
+    micro(1);
+    batch.size = 1;
+    while (
+        timeOf([&micro, &batch] { micro(batch.size); }) < _microTarget
+        && batch.size < (1lu << 40)
+    ) batch.size *= 2;
+
+    uint64_t n = batch.size;
+    batch.overhead = (uint64_t) -1;
+    for (int i = 0; i < 5; ++i) {
+        uint64_t t = timeOf([n] { emptyLoop(n); });
+        if (t < batch.overhead) batch.overhead = t;
+    }
+}
+
+double PerformanceTest::_timeRun(
+    const std::function<void()> &func,
+    const std::function<void(uint64_t)> &micro,
+    const Batch &batch,
+    size_t *allocations,
+    PhaseCounters *counters
+) {
+    if (_flushCaches) _flush();
+
+    CounterValues start;
+    if (counters != nullptr && sandbox().countersOpen()) sandbox().readCounters(start);
+
+    size_t blocks = sandbox().memoryAllocationCount();
+
+    double time;
+    if (micro) {
+        uint64_t t = timeOf([&micro, &batch] { micro(batch.size); });
+        time = (t > batch.overhead ? t - batch.overhead : 0) / (double) batch.size;
+    }
+    else {
+        time = timeOf(func);
+    }
+
+    if (allocations != nullptr) {
+        *allocations = (sandbox().memoryAllocationCount() - blocks) / batch.size;
+    }
+
+    if (counters != nullptr && sandbox().countersOpen()) {
+        CounterValues end;
+        sandbox().readCounters(end);
+        CounterValues run = end - start;
+
+        counters->values += run;
+        counters->iterations += batch.size;
+
+        if (_metric == Metric::INSTRUCTIONS) {
+            sandbox().lock();
+            counters->work.push_back(workOf(run, batch.size));
+            sandbox().unlock();
+        }
+    }
+
+    return time;
+}
+
+void PerformanceTest::_flush() {
+    // writing every cache line of a buffer larger than the last level cache
+    // evicts the caches, and touching one line per page evicts the TLB
+    static const size_t size = 64 << 20;
+
+    if (_flushBuffer == nullptr) {
+        sandbox().lock();
+        void *p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        sandbox().unlock();
+
+        if (p == MAP_FAILED) return;
+        _flushBuffer = (char *) p;
+    }
+
+    for (size_t i = 0; i < size; i += 64) _flushBuffer[i] = i;
+    clobberMemory();
+}
+
+void PerformanceTest::_releaseFlushBuffer() {
+    if (_flushBuffer == nullptr) return;
+
+    sandbox().lock();
+    munmap(_flushBuffer, 64 << 20);
+    sandbox().unlock();
+
+    _flushBuffer = nullptr;
+}
+
+void PerformanceTest::_measure(
+    const std::function<void()> &func,
+    const std::function<void(uint64_t)> &micro,
+    uint64_t &time,
+    size_t &allocations,
+    std::vector<double> &samples,
+    Batch &batch,
+    PhaseCounters &counters
+) {
+    _calibrate(micro, batch);
+
+    for (size_t i = 0; i < _warmup; ++i) _timeRun(func, micro, batch);
+
+    if (_latency) sandbox().resetLatency();
+
+    // samples outlive the sandbox, so they are kept out of the memory profile
+    sandbox().lock();
+    samples.clear();
+    samples.reserve(_repetitions);
+    counters.work.clear();
+    sandbox().unlock();
+
+    // the minimum time counts the elapsed wall time, since the samples of
+    // bodies cheaper than the timer overhead may all be 0
+    uint64_t start = now();
+    while (samples.size() < _repetitions || now() - start < _minTime) {
+        double t = _timeRun(func, micro, batch, samples.empty() ? &allocations : nullptr, &counters);
+
+        sandbox().lock();
+        samples.push_back(t);
+        sandbox().unlock();
+    }
+
+    _releaseFlushBuffer();
+
+    sandbox().lock();
+    time = Summary(samples).median;
+    sandbox().unlock();
+}
+
+void PerformanceTest::_measureInterleaved() {
+    _calibrate(_microBody, _bodyBatch);
+    _calibrate(_microBaseline, _baselineBatch);
+
+    for (size_t i = 0; i < _warmup; ++i) {
+        _timeRun(_body, _microBody, _bodyBatch);
+        _timeRun(_baseline, _microBaseline, _baselineBatch);
+    }
+
+    if (_latency) sandbox().resetLatency();
+
+    sandbox().lock();
+    _bodySamples.clear();
+    _bodySamples.reserve(_repetitions);
+    _baselineSamples.clear();
+    _baselineSamples.reserve(_repetitions);
+    _bodyCounters.work.clear();
+    _baselineCounters.work.clear();
+    sandbox().unlock();
+
+    // the order of each pair is drawn from a fixed seed, so that runs are
+    // reproducible
+    uint64_t order = 0x9e3779b97f4a7c15lu;
+
+    uint64_t start = now();
+    while (_bodySamples.size() < _repetitions || now() - start < _minTime) {
+        bool first = _bodySamples.empty();
+        bool bodyFirst = true;
+        if (_interleave == Interleave::RANDOM) {
+            order ^= order << 13;
+            order ^= order >> 7;
+            order ^= order << 17;
+            bodyFirst = order & 1;
+        }
+
+        double body, baseline;
+        for (int i = 0; i < 2; ++i) {
+            if ((i == 0) == bodyFirst) {
+                body = _timeRun(
+                    _body,
+                    _microBody,
+                    _bodyBatch,
+                    first ? &_bodyAllocations : nullptr,
+                    &_bodyCounters
+                );
+            }
+            else {
+                baseline = _timeRun(
+                    _baseline,
+                    _microBaseline,
+                    _baselineBatch,
+                    first ? &_baselineAllocations : nullptr,
+                    &_baselineCounters
+                );
+            }
+        }
+
+        sandbox().lock();
+        _bodySamples.push_back(body);
+        _baselineSamples.push_back(baseline);
+        sandbox().unlock();
+    }
+
+    _releaseFlushBuffer();
+
+    sandbox().lock();
+    _bodyTime = Summary(_bodySamples).median;
+    _baselineTime = Summary(_baselineSamples).median;
+    sandbox().unlock();
+}
+
+void PerformanceTest::_measureVariants() {
+    for (auto &v : _variants) _calibrate(v.micro, v.batch);
+
+    for (size_t i = 0; i < _warmup; ++i) {
+        for (auto &v : _variants) _timeRun(v.func, v.micro, v.batch);
+    }
+
+    sandbox().lock();
+    for (auto &v : _variants) {
+        v.samples.clear();
+        v.samples.reserve(_repetitions);
+    }
+    sandbox().unlock();
+
+    // every round runs each variant once, so that the i-th samples of all
+    // variants are taken under the same conditions
+    size_t n = _variants.size();
+    uint64_t start = now();
+    for (size_t round = 0; _variants[0].samples.size() < _repetitions || now() - start < _minTime; ++round) {
+        for (size_t i = 0; i < n; ++i) {
+            auto &v = _variants[(round + i) % n];
+            double t = _timeRun(v.func, v.micro, v.batch, round == 0 ? &v.allocations : nullptr);
+
+            sandbox().lock();
+            v.samples.push_back(t);
+            sandbox().unlock();
+        }
+    }
+
+    _releaseFlushBuffer();
+}
+
+void PerformanceTest::_measureParams(
+    const std::function<void(uint64_t)> &func,
+    std::vector<double> &times,
+    uint64_t &time,
+    size_t &allocations,
+    std::vector<double> &samples,
+    Batch &batch,
+    PhaseCounters &counters
+) {
+    sandbox().lock();
+    times.clear();
+    times.reserve(_params.size());
+    sandbox().unlock();
+
+    for (auto n : _params) {
+        if (_paramInit) _paramInit(n);
+
+        _measure([&func, n] { func(n); }, nullptr, time, allocations, samples, batch, counters);
+
+        sandbox().lock();
+        times.push_back(Summary(samples).median);
+        sandbox().unlock();
+    }
+}
+
+void PerformanceTest::_runBody() {
+    if (_latency) sandbox().resetLatency();
+
+    if (! _params.empty()) {
+        _measureParams(
+            _paramBody ? _paramBody : [this] (uint64_t) { if (_body) _body(); },
+            _bodyParamTimes,
+            _bodyTime,
+            _bodyAllocations,
+            _bodySamples,
+            _bodyBatch,
+            _bodyCounters
+        );
+    }
+    else if (_body || _microBody || _variants.empty()) {
+        if (_interleaved()) {
+            _measureInterleaved();
+        }
+        else {
+            _measure(
+                _body,
+                _microBody,
+                _bodyTime,
+                _bodyAllocations,
+                _bodySamples,
+                _bodyBatch,
+                _bodyCounters
+            );
+        }
+    }
+
+    // bodies that do not record their own latencies are timed per run
+    if (_latency && sandbox().latency().count() == 0) {
+        for (auto t : _bodySamples) sandbox().recordLatency(t);
+    }
+
+    if (! _variants.empty()) _measureVariants();
+}
+
+void PerformanceTest::_sendBodyResults(Message &m) {
+    m << _bodyBatch
+        << _bodyParamTimes
+        << _bodyCounters.values
+        << _bodyCounters.iterations
+        << _bodyCounters.work;
+
+    for (const auto &v : _variants) {
+        m << v.samples
+            << v.allocations
+            << v.batch;
+    }
+
+    if (_latency) {
+        sandbox().latency().save(_latencyBuckets, _latencyCounts, _latencySum, _latencyMin, _latencyMax);
+        m << _latencyBuckets
+            << _latencyCounts
+            << _latencySum
+            << _latencyMin
+            << _latencyMax;
+    }
+
+    if (_interleaved()) {
+        m << _baselineTime
+            << _baselineSamples
+            << _baselineAllocations
+            << _baselineBatch
+            << _baselineCounters.values
+            << _baselineCounters.iterations
+            << _baselineCounters.work;
+    }
+}
+
+void PerformanceTest::_recvBodyResults(Message &m) {
+    m >> _bodyBatch
+        >> _bodyParamTimes
+        >> _bodyCounters.values
+        >> _bodyCounters.iterations
+        >> _bodyCounters.work;
+
+    for (auto &v : _variants) {
+        m >> v.samples
+            >> v.allocations
+            >> v.batch;
+    }
+
+    if (_latency) {
+        m >> _latencyBuckets
+            >> _latencyCounts
+            >> _latencySum
+            >> _latencyMin
+            >> _latencyMax;
+    }
+
+    if (_interleaved()) {
+        m >> _baselineTime
+            >> _baselineSamples
+            >> _baselineAllocations
+            >> _baselineBatch
+            >> _baselineCounters.values
+            >> _baselineCounters.iterations
+            >> _baselineCounters.work;
+    }
+}
+
 void PerformanceTest::_checkPerformance() {
-    if (_performanceMarginRatio == 0) {
-        if (_bodyTime + _performanceMargin >= _baselineTime) {
-            _status = Status::TOO_SLOW;
-            err(
-                "Failed to meet performance requirements with a margin of "
-                + formatDuration(_performanceMargin)
+    // with the instructions metric, wall time is only reported, and absolute
+    // margins, being durations, do not apply
+    bool instructions = _metric == Metric::INSTRUCTIONS;
+    const auto &bodySamples = instructions ? _bodyCounters.work : _bodySamples;
+    const auto &baselineSamples = instructions ? _baselineCounters.work : _baselineSamples;
+    uint64_t margin = instructions ? 0 : _margin();
+
+    std::string metric = ! instructions
+        ? "time"
+        : (_bodyCounters.values.has(CounterValues::INSTRUCTIONS) ? "instructions" : "CPU time");
+    std::string less = (metric == "instructions" ? "fewer " : "less ") + metric;
+
+    // the CPU time read through getrusage advances by scheduler ticks, which
+    // runs shorter than a tick never reach
+    auto unmeasured = [] (const std::vector<double> &samples) {
+        return std::all_of(samples.begin(), samples.end(), [] (double w) { return w == 0; });
+    };
+
+    if (instructions && (bodySamples.empty() || baselineSamples.empty())) {
+        _status = Status::FAIL;
+        err("Failed to count the instructions of the body and the baseline");
+    }
+    else if (instructions && (unmeasured(bodySamples) || unmeasured(baselineSamples))) {
+        _status = Status::FAIL;
+        err(
+            "Metric unavailable: the " + metric + " of every run of the "
+            + (unmeasured(bodySamples) ? "body" : "baseline")
+            + " is zero, the runs are shorter than the resolution of the counter"
+        );
+    }
+    else if (bodySamples.size() > 1 && baselineSamples.size() > 1) {
+        // the body is shifted (or scaled) by the required margin, and then
+        // has to be significantly faster than the baseline
+        std::vector<double> body, baseline;
+        for (auto t : bodySamples) {
+            body.push_back(
+                _performanceMarginRatio == 0
+                ? t + margin
+                : t / _performanceMarginRatio
+            );
+        }
+        for (auto t : baselineSamples) baseline.push_back(t);
+
+        std::string requirement = _performanceMarginRatio == 0
+            ? (instructions ? less : "a margin of " + formatDuration(margin))
+            : std::to_string(_performanceMarginRatio) + " of the baseline " + metric;
+
+        // interleaved runs are compared as pairs
+        bool paired = _interleaved();
+
+        if (_significance == Significance::MANN_WHITNEY) {
+            _significanceResult = paired
+                ? wilcoxonSignedRank(body, baseline)
+                : mannWhitneyU(body, baseline);
+            if (_significanceResult > _alpha) {
+                _status = Status::TOO_SLOW;
+                err(
+                    "Failed to meet performance requirements of " + requirement
+                    + (paired ? " (Wilcoxon signed-rank p-value " : " (Mann-Whitney U p-value ")
+                    + std::to_string(_significanceResult)
+                    + " > " + std::to_string(_alpha) + ")"
+                );
+            }
+        }
+        else {
+            _significanceResult = bootstrapUpperBound(
+                body,
+                baseline,
+                [] (const std::vector<double> &a, const std::vector<double> &b) {
+                    return mean(a) / mean(b);
+                },
+                1 - _alpha,
+                paired
             );
+            if (_significanceResult >= 1) {
+                _status = Status::TOO_SLOW;
+                err(
+                    "Failed to meet performance requirements of " + requirement
+                    + " (bootstrap upper bound of the " + metric + " ratio "
+                    + std::to_string(_significanceResult) + " >= 1)"
+                );
+            }
         }
     }
     else {
-        if (_bodyTime > _baselineTime * _performanceMarginRatio) {
+        double body = instructions ? Summary(bodySamples).median : _bodyTime;
+        double baseline = instructions ? Summary(baselineSamples).median : _baselineTime;
+
+        if (_performanceMarginRatio == 0) {
+            if (body + margin >= baseline) {
+                _status = Status::TOO_SLOW;
+                err(
+                    instructions
+                    ? "Failed to meet performance requirements of " + less
+                    : "Failed to meet performance requirements with a margin of " + formatDuration(margin)
+                );
+            }
+        }
+        else if (body > baseline * _performanceMarginRatio) {
             _status = Status::TOO_SLOW;
             err(
                 "Failed to meet performance requirements of "
-                + std::to_string(_performanceMarginRatio) + " of the baseline time"
+                + std::to_string(_performanceMarginRatio) + " of the baseline " + metric
+            );
+        }
+    }
+
+    if (_bodyAllocations > _maxAllocationsPerBody) {
+        _status = Status::TOO_SLOW;
+        err(
+            "Failed to meet the limit of " + std::to_string(_maxAllocationsPerBody)
+            + " allocation(s) per body run with " + std::to_string(_bodyAllocations)
+            + " allocation(s)"
+        );
+    }
+}
+
+static double timeRatio(const std::vector<double> &a, const std::vector<double> &b) {
+    return mean(a) / mean(b);
+}
+
+void PerformanceTest::_checkVariants() {
+    if (_variants.empty() || _variants[0].samples.empty()) return;
+
+    const Variant *slowest = &_variants[0];
+    for (const auto &v : _variants) {
+        if (mean(v.samples) > mean(slowest->samples)) slowest = &v;
+    }
+
+    for (auto &v : _variants) {
+        auto interval = bootstrapInterval(slowest->samples, v.samples, timeRatio, 1 - _alpha, true);
+        v.speedup = timeRatio(slowest->samples, v.samples);
+        v.speedupLow = interval.first;
+        v.speedupHigh = interval.second;
+    }
+
+    for (const auto &e : _expectedSpeedups) {
+        const Variant *faster = nullptr, *slower = nullptr;
+        for (const auto &v : _variants) {
+            if (v.name == e.faster) faster = &v;
+            if (v.name == e.slower) slower = &v;
+        }
+
+        if (faster == nullptr || slower == nullptr) {
+            _status = Status::FAIL;
+            err(
+                "Unknown variant \"" + (faster == nullptr ? e.faster : e.slower)
+                + "\" in speedup expectation"
+            );
+            continue;
+        }
+
+        // lower confidence bound of the speedup of faster over slower
+        double speedup = 1 / bootstrapUpperBound(
+            faster->samples,
+            slower->samples,
+            timeRatio,
+            1 - _alpha,
+            true
+        );
+
+        if (speedup < e.factor) {
+            _status = Status::TOO_SLOW;
+            err(
+                "Variant \"" + e.faster + "\" is not at least " + std::to_string(e.factor)
+                + "x faster than \"" + e.slower + "\" (lower bound of the speedup "
+                + std::to_string(speedup) + "x)"
+            );
+        }
+    }
+}
+
+void PerformanceTest::_checkComplexity() {
+    if (_bodyParamTimes.size() < 2) return;
+
+    _bodyFit = fitComplexity(_params, _bodyParamTimes);
+
+    if (_complexityExpected && _bodyFit.complexity > _expectedComplexity) {
+        _status = Status::TOO_SLOW;
+        err(
+            "Body complexity " + toString(_bodyFit.complexity)
+            + " exceeds the expected " + toString(_expectedComplexity)
+        );
+    }
+}
+
+void PerformanceTest::_checkLatency() {
+    if (_latencyCounts.empty()) return;
+
+    LatencyHistogram histogram;
+    histogram.load(_latencyBuckets, _latencyCounts, _latencySum, _latencyMin, _latencyMax);
+
+    for (const auto &limit : _latencyLimits) {
+        uint64_t value = histogram.percentile(limit.percentile / 100);
+        if (value > limit.nanos) {
+            std::stringstream p;
+            p << limit.percentile;
+
+            _status = Status::TOO_SLOW;
+            err(
+                "Latency percentile " + p.str() + " of " + formatDuration(value)
+                + " exceeds the limit of " + formatDuration(limit.nanos)
             );
         }
     }
@@ -33,6 +611,18 @@ void PerformanceTest::_checkPerformance() {
 void PerformanceTest::_driverRun() {
     UnitTest::_driverRun();
 
+    _checkVariants();
+    _checkComplexity();
+    _checkLatency();
+
+    if (! _baseline && ! _microBaseline && ! _variants.empty()) return;
+
+    // interleaved runs measure the baseline in the body sandbox
+    if (_interleaved()) {
+        if (! _bodySamples.empty()) _checkPerformance();
+        return;
+    }
+
     auto opt = Sandbox::Options();
     opt.fork(! _inProcessSandbox);
 
@@ -40,10 +630,34 @@ void PerformanceTest::_driverRun() {
         _timeout < 2000000000lu ? 2000000000lu : _timeout,
         [this] {
             _configure();
+            sandbox().memoryLimits((size_t) -1, (size_t) -1);
+            if (_counters) sandbox().openCounters();
 
             timeOf(_onInit);
-            _baselineTime = timeOf(_baseline);
+            if (! _params.empty()) {
+                _measureParams(
+                    _paramBaseline ? _paramBaseline : [this] (uint64_t) { if (_baseline) _baseline(); },
+                    _baselineParamTimes,
+                    _baselineTime,
+                    _baselineAllocations,
+                    _baselineSamples,
+                    _baselineBatch,
+                    _baselineCounters
+                );
+            }
+            else {
+                _measure(
+                    _baseline,
+                    _microBaseline,
+                    _baselineTime,
+                    _baselineAllocations,
+                    _baselineSamples,
+                    _baselineBatch,
+                    _baselineCounters
+                );
+            }
             timeOf(_onComplete);
+            sandbox().closeCounters();
         },
         [this] (Message &m) {
             _checkMemoryLeak();
@@ -51,12 +665,28 @@ void PerformanceTest::_driverRun() {
 
             m << _status
                 << _errors
-                << _baselineTime;
+                << _baselineTime
+                << _baselineSamples
+                << _baselineAllocations
+                << _baselineBatch
+                << _baselineParamTimes
+                << _baselineCounters.values
+                << _baselineCounters.iterations
+                << _baselineCounters.work
+                << _significanceResult;
         },
         [this] (Message &m) {
             m >> _status
                 >> _errors
-                >> _baselineTime;
+                >> _baselineTime
+                >> _baselineSamples
+                >> _baselineAllocations
+                >> _baselineBatch
+                >> _baselineParamTimes
+                >> _baselineCounters.values
+                >> _baselineCounters.iterations
+                >> _baselineCounters.work
+                >> _significanceResult;
         },
         [this] (const std::string &error) {
             _status = Status::FAIL;
@@ -66,6 +696,94 @@ void PerformanceTest::_driverRun() {
     );
 
     if (! finish) _status = Status::TIMEOUT;
+
+    if (_baselineParamTimes.size() > 1) {
+        _baselineFit = fitComplexity(_params, _baselineParamTimes);
+    }
+}
+
+static std::string microReport(uint64_t batchSize, uint64_t overhead, const std::vector<double> &samples) {
+    std::stringstream s;
+    s.setf(std::ios::fixed);
+    s.precision(3);
+
+    s << "\"batchSize\": " << batchSize;
+    s << ",\n\"overhead\": " << formatDurationJSON(overhead);
+    s << ",\n\"nsPerOp\": " << Summary(samples).median;
+
+    return s.str();
+}
+
+static std::string fitReport(const ComplexityFit &fit) {
+    std::stringstream s;
+    s << "\"class\": " << jsonify(toString(fit.complexity));
+    s << ",\n\"coefficient\": " << formatDurationJSON(fit.coefficient);
+    s << ",\n\"rms\": " << fit.rms;
+    return s.str();
+}
+
+std::string PerformanceTest::_paramReport() {
+    std::stringstream s;
+
+    s << "\"params\": [";
+    for (size_t i = 0; i < _params.size() && i < _bodyParamTimes.size(); ++i) {
+        if (i > 0) s << ",";
+        s << "\n  {";
+        s << "\n    \"n\": " << _params[i];
+        s << ",\n    \"body\": " << formatDurationJSON(_bodyParamTimes[i]);
+        if (i < _baselineParamTimes.size()) {
+            s << ",\n    \"baseline\": " << formatDurationJSON(_baselineParamTimes[i]);
+        }
+        s << "\n  }";
+    }
+    s << "\n]";
+
+    if (_bodyParamTimes.size() > 1) {
+        s << ",\n\"complexity\": {";
+        s << "\n  \"body\": {\n" << indent(fitReport(_bodyFit), 4) << "\n  }";
+        if (_baselineParamTimes.size() > 1) {
+            s << ",\n  \"baseline\": {\n" << indent(fitReport(_baselineFit), 4) << "\n  }";
+        }
+        s << "\n}";
+    }
+
+    return s.str();
+}
+
+std::string PerformanceTest::_variantReport() {
+    std::vector<const Variant *> ranked;
+    for (const auto &v : _variants) ranked.push_back(&v);
+    std::stable_sort(ranked.begin(), ranked.end(), [] (const Variant *a, const Variant *b) {
+        return a->speedup > b->speedup;
+    });
+
+    std::stringstream s;
+    s << "\"variants\": [";
+
+    for (size_t i = 0; i < ranked.size(); ++i) {
+        auto v = ranked[i];
+
+        std::stringstream vs;
+        vs.setf(std::ios::fixed);
+        vs.precision(3);
+
+        vs << "\"rank\": " << i + 1;
+        vs << ",\n\"name\": " << jsonify(v->name);
+        vs << ",\n\"time\": " << formatDurationJSON(Summary(v->samples).median);
+        vs << ",\n\"speedup\": " << v->speedup;
+        vs << ",\n\"speedupInterval\": [" << v->speedupLow << ", " << v->speedupHigh << "]";
+        vs << ",\n\"allocationsPerRun\": " << v->allocations;
+        if (v->samples.size() > 1) {
+            vs << ",\n\"statistics\": {\n" << indent(Summary(v->samples).toString(), 2) << "\n}";
+        }
+
+        if (i > 0) s << ",";
+        s << "\n  {\n" << indent(vs.str(), 4) << "\n  }";
+    }
+
+    s << "\n]";
+
+    return s.str();
 }
 
 void PerformanceTest::_report(bool driver, std::stringstream &s) {
@@ -84,6 +802,105 @@ void PerformanceTest::_report(bool driver, std::stringstream &s) {
     }
     s << "\n}";
 
+    s << ",\n\"allocationsPerBody\": {";
+    s << "\n  \"body\": " << _bodyAllocations;
+    s << ",\n  \"baseline\": " << _baselineAllocations;
+    s << "\n}";
+
+    if (_microBody || _microBaseline) {
+        s << ",\n\"microbenchmark\": {";
+        if (_microBody) {
+            s << "\n  \"body\": {\n"
+                << indent(microReport(_bodyBatch.size, _bodyBatch.overhead, _bodySamples), 4)
+                << "\n  }";
+            if (_microBaseline) s << ",";
+        }
+        if (_microBaseline) {
+            s << "\n  \"baseline\": {\n"
+                << indent(microReport(_baselineBatch.size, _baselineBatch.overhead, _baselineSamples), 4)
+                << "\n  }";
+        }
+        s << "\n}";
+    }
+
+    std::stringstream significance;
+    if (_significanceResult >= 0) {
+        significance << "\"significance\": {";
+        if (_significance == Significance::MANN_WHITNEY) {
+            significance << "\n  \"test\": \""
+                << (_interleaved() ? "wilcoxon-signed-rank" : "mann-whitney-u")
+                << "\"";
+            significance << ",\n  \"alpha\": " << _alpha;
+            significance << ",\n  \"pValue\": " << _significanceResult;
+        }
+        else {
+            significance << "\n  \"test\": \""
+                << (_interleaved() ? "paired-bootstrap" : "bootstrap")
+                << "\"";
+            significance << ",\n  \"confidence\": " << 1 - _alpha;
+            significance << ",\n  \"ratioUpperBound\": " << _significanceResult;
+        }
+        significance << "\n}";
+    }
+
+    bool instructions = _metric == Metric::INSTRUCTIONS;
+
+    if (_bodySamples.size() > 1 || _baselineSamples.size() > 1) {
+        s << ",\n\"statistics\": {";
+        s << "\n  \"body\": {\n" << indent(Summary(_bodySamples).toString(), 4) << "\n  }";
+        s << ",\n  \"baseline\": {\n" << indent(Summary(_baselineSamples).toString(), 4) << "\n  }";
+        if (! instructions && _significanceResult >= 0) {
+            s << ",\n" << indent(significance.str(), 2);
+        }
+        s << "\n}";
+    }
+
+    if (instructions && (! _bodyCounters.work.empty() || ! _baselineCounters.work.empty())) {
+        // CPU times are reported as durations where the PMU is not available
+        bool counted = _bodyCounters.values.has(CounterValues::INSTRUCTIONS);
+
+        s << ",\n\"instructions\": {";
+        s << "\n  \"source\": \"" << (counted ? "hardware" : "software") << "\"";
+        s << ",\n  \"metric\": \"" << (counted ? "instructions" : "cpuTime") << "\"";
+        s << ",\n  \"body\": {\n" << indent(Summary(_bodyCounters.work).toString(! counted), 4) << "\n  }";
+        s << ",\n  \"baseline\": {\n" << indent(Summary(_baselineCounters.work).toString(! counted), 4) << "\n  }";
+        if (_significanceResult >= 0) {
+            s << ",\n" << indent(significance.str(), 2);
+        }
+        s << "\n}";
+    }
+
+    if (! _latencyCounts.empty()) {
+        LatencyHistogram histogram;
+        histogram.load(_latencyBuckets, _latencyCounts, _latencySum, _latencyMin, _latencyMax);
+        s << ",\n\"latency\": {\n" << indent(histogram.report(), 2) << "\n}";
+    }
+
+    if (! _bodyParamTimes.empty()) {
+        s << ",\n" << _paramReport();
+    }
+
+    if (! _variants.empty() && ! _variants[0].samples.empty()) {
+        s << ",\n" << _variantReport();
+    }
+
+    if (_bodyCounters.iterations > 0 || _baselineCounters.iterations > 0) {
+        // averaged over the iterations of the measured runs
+        s << ",\n\"counters\": {";
+        if (_bodyCounters.iterations > 0) {
+            s << "\n  \"body\": {\n"
+                << indent(_bodyCounters.values.report(_bodyCounters.iterations), 4)
+                << "\n  }";
+            if (_baselineCounters.iterations > 0) s << ",";
+        }
+        if (_baselineCounters.iterations > 0) {
+            s << "\n  \"baseline\": {\n"
+                << indent(_baselineCounters.values.report(_baselineCounters.iterations), 4)
+                << "\n  }";
+        }
+        s << "\n}";
+    }
+
     if (_hasMemoryReport()) {
         s << ",\n\"memory\": {\n" << indent(_memoryReport(), 2) << "\n}";
     }
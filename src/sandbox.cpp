@@ -11,6 +11,7 @@
 #include <dtest_core/util.h>
 #include <thread>
 #include <fcntl.h>
+#include <fstream>
 
 using namespace dtest;
 
@@ -19,6 +20,7 @@ namespace dtest {
 enum class MessageCode : uint8_t {
     COMPLETE,
     ERROR,
+    FATAL_ERROR,
 };
 
 }
@@ -173,6 +175,24 @@ void Sandbox::unlock() {
     _network.unlock();
 }
 
+void Sandbox::fatalError(const SandboxFatalException &e) {
+    exitAll();
+
+    // a forked sandbox is stopped right away, since the error may be raised
+    // from a context that cannot unwind (e.g. a C library or a noexcept function)
+    if (! _forked) throw e;
+
+    Message m;
+    m << MessageCode::FATAL_ERROR
+        << e.code()
+        << std::string(e.what());
+    m.send(_clientSocket);
+
+    _clientSocket.close();
+
+    ::exit(1);
+}
+
 bool Sandbox::run(
     uint64_t timeoutNanos,
     const std::function<void()> &func,
@@ -191,6 +211,8 @@ bool Sandbox::run(
     pid_t pid = options._fork ? fork() : 0;
 
     if (pid == 0) {
+        _forked = options._fork;
+
         if (options._fork) {
             _serverSocket.close();
 
@@ -213,6 +235,14 @@ bool Sandbox::run(
                 onComplete(m);
                 m.send(_clientSocket);
             }
+            catch (const SandboxFatalException &e) {
+                exitAll();
+                Message m;
+                m << MessageCode::FATAL_ERROR
+                    << e.code()
+                    << std::string(e.what());
+                m.send(_clientSocket);
+            }
             catch (const SandboxException &e) {
                 exitAll();
                 Message m;
@@ -289,6 +319,14 @@ bool Sandbox::run(
         }
         break;
 
+        case MessageCode::FATAL_ERROR: {
+            std::string reason;
+            m >> options._fatalError >> reason;
+            onError(reason);
+            finished = true;
+        }
+        break;
+
         default: {
             if (options._fork) kill(pid, SIGKILL);
             onError("An unexpected error has occurred");
@@ -327,8 +365,12 @@ void Sandbox::resourceSnapshot(ResourceSnapshot &snapshot) {
     // initialization
     if (! snapshot.initialized) {
         _memory.resetMaxAllocation();
+        _memory.resetProfile();
         snapshot.initialized = true;
     }
+    else {
+        _memory.stopTimeline();
+    }
 
     snapshot.memory.allocate.size = _memory._allocateSize - snapshot.memory.allocate.size;
     snapshot.memory.allocate.count = _memory._allocateCount - snapshot.memory.allocate.count;
@@ -336,6 +378,12 @@ void Sandbox::resourceSnapshot(ResourceSnapshot &snapshot) {
     snapshot.memory.deallocate.size = _memory._freeSize - snapshot.memory.deallocate.size;
     snapshot.memory.deallocate.count = _memory._freeCount - snapshot.memory.deallocate.count;
 
+    snapshot.memory.poolAllocate.size = _memory._poolAllocateSize - snapshot.memory.poolAllocate.size;
+    snapshot.memory.poolAllocate.count = _memory._poolAllocateCount - snapshot.memory.poolAllocate.count;
+
+    snapshot.memory.poolDeallocate.size = _memory._poolFreeSize - snapshot.memory.poolDeallocate.size;
+    snapshot.memory.poolDeallocate.count = _memory._poolFreeCount - snapshot.memory.poolDeallocate.count;
+
     snapshot.memory.max.size = _memory._maxAllocate;
     snapshot.memory.max.count = _memory._maxAllocateCount;
 
@@ -344,6 +392,20 @@ void Sandbox::resourceSnapshot(ResourceSnapshot &snapshot) {
 
     snapshot.network.receive.size = _network._recvSize - snapshot.network.receive.size;
     snapshot.network.receive.count = _network._recvCount - snapshot.network.receive.count;
+
+    if (_counters.isOpen()) {
+        CounterValues counters;
+        _counters.read(counters);
+        snapshot.counters = counters - snapshot.counters;
+    }
+}
+
+void Sandbox::exportMemoryProfile(const std::string &prefix) {
+    std::ofstream live(prefix + ".inuse.folded", std::ios_base::out | std::ios_base::trunc);
+    _memory.exportProfile(live, true);
+
+    std::ofstream total(prefix + ".alloc.folded", std::ios_base::out | std::ios_base::trunc);
+    _memory.exportProfile(total, false);
 }
 
 Sandbox & dtest::sandbox() {
@@ -374,6 +436,8 @@ void LibC::_init() {
 
     free = (void (*)(void *)) dlsym(RTLD_NEXT, "free");
 
+    malloc_usable_size = (size_t (*)(void *)) dlsym(RTLD_NEXT, "malloc_usable_size");
+
     mmap = (void *(*)(void *, size_t, int, int, int, __off_t)) dlsym(RTLD_NEXT, "mmap");
 
     mremap = (void *(*)(void *, size_t, size_t, int, ...)) dlsym(RTLD_NEXT, "mremap");
@@ -387,6 +451,8 @@ void LibC::_init() {
     recv = (ssize_t (*)(int, void *, size_t, int)) dlsym(RTLD_NEXT, "recv");
 
     recvfrom = (ssize_t (*)(int, void * __restrict, size_t, int, struct sockaddr * __restrict, socklen_t * __restrict)) dlsym(RTLD_NEXT, "recvfrom");
+
+    pthread_create = (int (*)(pthread_t *, const pthread_attr_t *, void * (*)(void *), void *)) dlsym(RTLD_NEXT, "pthread_create");
 }
 
 static LibC libc_instance;
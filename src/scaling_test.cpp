@@ -0,0 +1,162 @@
+/*
+ * Copyright (c) 2021 Noah Orensa.
+ * Licensed under the MIT license. See LICENSE file in the project root for details.
+*/
+
+#include <dtest_core/scaling_test.h>
+#include <dtest_core/sandbox.h>
+#include <dtest_core/statistics.h>
+#include <dtest_core/time_of.h>
+#include <dtest_core/util.h>
+#include <algorithm>
+#include <thread>
+#include <dlfcn.h>
+#include <stdlib.h>
+
+using namespace dtest;
+
+std::vector<size_t> ScalingTest::_sweep() const {
+    std::vector<size_t> counts = _threadCounts;
+
+    if (counts.empty()) {
+        size_t cores = _maxThreads;
+        if (cores == 0) cores = std::thread::hardware_concurrency();
+        if (cores == 0) cores = 1;
+
+        for (size_t p = 1; p < cores; p *= 2) counts.push_back(p);
+        counts.push_back(cores);
+    }
+
+    // speedups are relative to a single thread
+    counts.push_back(1);
+    std::sort(counts.begin(), counts.end());
+    counts.erase(std::unique(counts.begin(), counts.end()), counts.end());
+    if (counts.front() == 0) counts.erase(counts.begin());
+
+    return counts;
+}
+
+static void setOmpThreads(size_t threads) {
+    typedef void (*SetNumThreads)(int);
+
+    // OpenMP is only used if the test is linked against it
+    auto setNumThreads = (SetNumThreads) dlsym(RTLD_DEFAULT, "omp_set_num_threads");
+    if (setNumThreads != nullptr) setNumThreads(threads);
+
+    setenv("OMP_NUM_THREADS", std::to_string(threads).c_str(), 1);
+}
+
+void ScalingTest::_runBody() {
+    sandbox().lock();
+    _scaleThreads = _sweep();
+    _scaleTimes.clear();
+    _scaleTimes.reserve(_scaleThreads.size());
+    _scaleSamples.reserve(_repetitions);
+    sandbox().unlock();
+
+    _bodyTime = 0;
+
+    for (auto p : _scaleThreads) {
+        if (_ompThreads) {
+            sandbox().lock();
+            setOmpThreads(p);
+            sandbox().unlock();
+        }
+
+        sandbox().lock();
+        _scaleSamples.clear();
+        sandbox().unlock();
+
+        for (size_t i = 0; i < _repetitions; ++i) {
+            size_t blocks = sandbox().memoryAllocationCount();
+            uint64_t t = timeOf([this, p] { if (_scaleBody) _scaleBody(p); });
+            if (p == 1 && i == 0) _bodyAllocations = sandbox().memoryAllocationCount() - blocks;
+            _bodyTime += t;
+
+            sandbox().lock();
+            _scaleSamples.push_back(t);
+            sandbox().unlock();
+        }
+
+        sandbox().lock();
+        _scaleTimes.push_back(Summary(_scaleSamples).median);
+        sandbox().unlock();
+    }
+}
+
+void ScalingTest::_sendBodyResults(Message &m) {
+    m << _scaleThreads
+        << _scaleTimes;
+}
+
+void ScalingTest::_recvBodyResults(Message &m) {
+    m >> _scaleThreads
+        >> _scaleTimes;
+}
+
+void ScalingTest::_checkScaling() {
+    if (_scaleTimes.empty() || _scaleTimes.size() != _scaleThreads.size()) return;
+
+    for (const auto &e : _minEfficiency) {
+        auto it = std::find(_scaleThreads.begin(), _scaleThreads.end(), e.threads);
+        if (it == _scaleThreads.end()) {
+            _status = Status::FAIL;
+            err("Thread count " + std::to_string(e.threads) + " is not part of the sweep");
+            continue;
+        }
+
+        size_t i = it - _scaleThreads.begin();
+        double efficiency = _scaleTimes[0] / (e.threads * _scaleTimes[i]);
+
+        if (efficiency < e.min) {
+            _status = Status::TOO_SLOW;
+            err(
+                "Parallel efficiency of " + std::to_string(efficiency)
+                + " with " + std::to_string(e.threads) + " threads is below the minimum of "
+                + std::to_string(e.min)
+            );
+        }
+    }
+}
+
+void ScalingTest::_driverRun() {
+    UnitTest::_driverRun();
+    _checkScaling();
+}
+
+std::string ScalingTest::_scalingReport() {
+    std::stringstream s;
+    s.setf(std::ios::fixed);
+    s.precision(3);
+
+    s << "\"scaling\": [";
+
+    for (size_t i = 0; i < _scaleTimes.size() && i < _scaleThreads.size(); ++i) {
+        double p = _scaleThreads[i];
+        double speedup = _scaleTimes[0] / _scaleTimes[i];
+
+        if (i > 0) s << ",";
+        s << "\n  {";
+        s << "\n    \"threads\": " << _scaleThreads[i];
+        s << ",\n    \"time\": " << formatDurationJSON(_scaleTimes[i]);
+        s << ",\n    \"speedup\": " << speedup;
+        s << ",\n    \"efficiency\": " << speedup / p;
+        if (p > 1) {
+            // Karp-Flatt metric
+            s << ",\n    \"serialFraction\": " << (1 / speedup - 1 / p) / (1 - 1 / p);
+        }
+        s << "\n  }";
+    }
+
+    s << "\n]";
+
+    return s.str();
+}
+
+void ScalingTest::_report(bool driver, std::stringstream &s) {
+    UnitTest::_report(driver, s);
+
+    if (! _scaleTimes.empty()) {
+        s << ",\n" << _scalingReport();
+    }
+}
@@ -0,0 +1,124 @@
+/*
+ * Copyright (c) 2021 Noah Orensa.
+ * Licensed under the MIT license. See LICENSE file in the project root for details.
+*/
+
+#include <dtest_core/stack.h>
+#include <dtest_core/sandbox.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <sstream>
+
+using namespace dtest;
+
+namespace dtest {
+    Stack *_stackmgr_instance = nullptr;
+}
+
+Stack::Stack()
+: _threads(0)
+{
+    _stackmgr_instance = this;
+}
+
+// must not call any function while painting, since the callee's frame would
+// be placed on the painted part of the stack
+__attribute__((noinline))
+void Stack::_paint(Region &region) {
+    char here;
+    pthread_attr_t attr;
+    void *addr;
+    size_t size;
+
+    region = Region();
+
+    // reading the main thread stack bounds goes through stdio
+    sandbox().lock();
+    bool ok = pthread_getattr_np(pthread_self(), &attr) == 0;
+    if (ok) {
+        ok = pthread_attr_getstack(&attr, &addr, &size) == 0;
+        pthread_attr_destroy(&attr);
+    }
+    sandbox().unlock();
+
+    if (! ok) return;
+
+    char *low = (char *) addr;
+    char *top = low + size;
+    char *high = &here - _MARGIN;
+
+    if (getpid() == syscall(SYS_gettid)) low += _MAIN_GUARD;
+    if (high - low > (ptrdiff_t) _MAX_PAINT) low = high - _MAX_PAINT;
+    if (high <= low) return;
+
+    region.low = (uint64_t *) (((uintptr_t) low + 7) & ~(uintptr_t) 7);
+    region.high = (uint64_t *) ((uintptr_t) high & ~(uintptr_t) 7);
+    region.top = top;
+
+    for (volatile uint64_t *p = region.low; p < region.high; ++p) *p = _PATTERN;
+}
+
+size_t Stack::_scan(const Region &region) {
+    if (region.top == nullptr) return 0;
+
+    const uint64_t *p = region.low;
+    while (p < region.high && *p == _PATTERN) ++p;
+
+    return region.top - (const char *) p;
+}
+
+void Stack::start() {
+    _threads = 0;
+    _bodyPeak = 0;
+    _paint(_body);
+    _track = true;
+}
+
+void Stack::stop() {
+    _track = false;
+    _bodyPeak = _scan(_body);
+}
+
+void Stack::paintThread(Region &region) {
+    _paint(region);
+}
+
+void Stack::scanThread(const Region &region) {
+    size_t peak = _scan(region);
+    size_t i = _threads++;
+    if (i < _MAX_THREADS) _threadPeaks[i] = peak;
+}
+
+size_t Stack::peak() const {
+    size_t peak = _bodyPeak;
+    size_t n = _reportedThreads();
+
+    for (size_t i = 0; i < n; ++i) {
+        if (_threadPeaks[i] > peak) peak = _threadPeaks[i];
+    }
+
+    return peak;
+}
+
+std::string Stack::report() const {
+    std::stringstream s;
+    size_t n = _reportedThreads();
+
+    s << "\"stack\": {";
+    s << "\n  \"body\": " << _bodyPeak;
+    if (n > 0) {
+        s << ",\n  \"threads\": [";
+        for (size_t i = 0; i < n; ++i) {
+            if (i > 0) s << ", ";
+            s << _threadPeaks[i];
+        }
+        s << "]";
+    }
+    if (_threads > _MAX_THREADS) {
+        s << ",\n  \"unreportedThreads\": " << _threads - _MAX_THREADS;
+    }
+    s << "\n}";
+
+    return s.str();
+}
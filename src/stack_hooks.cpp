@@ -0,0 +1,60 @@
+/*
+ * Copyright (c) 2021 Noah Orensa.
+ * Licensed under the MIT license. See LICENSE file in the project root for details.
+*/
+
+#include <dtest_core/stack.h>
+#include <dtest_core/sandbox.h>
+#include <pthread.h>
+
+using namespace dtest;
+
+namespace dtest {
+    extern Stack *_stackmgr_instance;
+}
+
+struct ThreadStart {
+    void * (*routine)(void *);
+    void *arg;
+};
+
+static void _scanThread(void *region) {
+    _stackmgr_instance->scanThread(*(Stack::Region *) region);
+}
+
+static void * _startThread(void *start) {
+    ThreadStart t = *(ThreadStart *) start;
+    libc().free(start);
+
+    Stack::Region region;
+    void *res;
+
+    _stackmgr_instance->paintThread(region);
+
+    // also scan when the thread exits through pthread_exit
+    pthread_cleanup_push(_scanThread, &region);
+    res = t.routine(t.arg);
+    pthread_cleanup_pop(1);
+
+    return res;
+}
+
+int pthread_create(
+    pthread_t *thread,
+    const pthread_attr_t *attr,
+    void * (*start_routine)(void *),
+    void *arg
+) {
+    if (_stackmgr_instance == nullptr || ! _stackmgr_instance->tracking()) {
+        return libc().pthread_create(thread, attr, start_routine, arg);
+    }
+
+    auto start = (ThreadStart *) libc().malloc(sizeof(ThreadStart));
+    if (start == nullptr) return EAGAIN;
+    *start = { start_routine, arg };
+
+    int res = libc().pthread_create(thread, attr, _startThread, start);
+    if (res != 0) libc().free(start);
+
+    return res;
+}
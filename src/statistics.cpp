@@ -0,0 +1,277 @@
+/*
+ * Copyright (c) 2021 Noah Orensa.
+ * Licensed under the MIT license. See LICENSE file in the project root for details.
+*/
+
+#include <dtest_core/statistics.h>
+#include <dtest_core/util.h>
+#include <algorithm>
+#include <random>
+#include <sstream>
+#include <cmath>
+
+using namespace dtest;
+
+Summary::Summary(std::vector<double> x)
+: samples(x.size())
+{
+    if (x.empty()) return;
+
+    std::sort(x.begin(), x.end());
+
+    double sum = 0;
+    for (auto v : x) sum += v;
+    mean = sum / x.size();
+
+    double squares = 0;
+    for (auto v : x) squares += (v - mean) * (v - mean);
+    stddev = (x.size() > 1) ? std::sqrt(squares / (x.size() - 1)) : 0;
+
+    min = x.front();
+    median = dtest::percentile(x, 0.5);
+    p90 = dtest::percentile(x, 0.9);
+    p99 = dtest::percentile(x, 0.99);
+    max = x.back();
+}
+
+std::string Summary::toString(bool durations) const {
+    std::stringstream s;
+
+    auto value = [durations] (double x) {
+        if (durations) return formatDurationJSON(x);
+        std::stringstream v;
+        v.setf(std::ios::fixed);
+        v.precision(3);
+        v << x;
+        return v.str();
+    };
+
+    s << "\"samples\": " << samples;
+    s << ",\n\"mean\": " << value(mean);
+    s << ",\n\"median\": " << value(median);
+    s << ",\n\"stddev\": " << value(stddev);
+    s << ",\n\"min\": " << value(min);
+    s << ",\n\"p90\": " << value(p90);
+    s << ",\n\"p99\": " << value(p99);
+    s << ",\n\"max\": " << value(max);
+
+    return s.str();
+}
+
+double dtest::percentile(const std::vector<double> &sorted, double p) {
+    if (sorted.empty()) return 0;
+
+    size_t rank = std::ceil(p * sorted.size());
+    return sorted[(rank > 0) ? rank - 1 : 0];
+}
+
+double dtest::mannWhitneyU(const std::vector<double> &a, const std::vector<double> &b) {
+    if (a.empty() || b.empty()) return 1;
+
+    // rank the pooled samples, averaging the ranks of ties
+    std::vector<std::pair<double, bool>> pooled;
+    pooled.reserve(a.size() + b.size());
+    for (auto x : a) pooled.push_back({ x, true });
+    for (auto x : b) pooled.push_back({ x, false });
+    std::sort(pooled.begin(), pooled.end());
+
+    double n = pooled.size();
+    double rankSumA = 0;
+    double ties = 0;
+
+    for (size_t i = 0; i < pooled.size(); ) {
+        size_t j = i;
+        while (j < pooled.size() && pooled[j].first == pooled[i].first) ++j;
+
+        double rank = (i + j + 1) / 2.0;    // average of ranks i + 1 .. j
+        for (size_t k = i; k < j; ++k) {
+            if (pooled[k].second) rankSumA += rank;
+        }
+
+        double t = j - i;
+        ties += t * t * t - t;
+        i = j;
+    }
+
+    double na = a.size();
+    double nb = b.size();
+    double u = rankSumA - na * (na + 1) / 2;
+    double sigma = std::sqrt(na * nb / 12 * ((n + 1) - ties / (n * (n - 1))));
+    if (sigma == 0) return 1;
+
+    double z = (u - na * nb / 2 + 0.5) / sigma;
+    return 0.5 * std::erfc(-z / std::sqrt(2));
+}
+
+double dtest::wilcoxonSignedRank(const std::vector<double> &a, const std::vector<double> &b) {
+    // rank the non-zero differences by magnitude, averaging the ranks of ties
+    std::vector<double> d;
+    for (size_t i = 0; i < a.size() && i < b.size(); ++i) {
+        if (a[i] != b[i]) d.push_back(a[i] - b[i]);
+    }
+    if (d.empty()) return 1;
+
+    std::sort(d.begin(), d.end(), [] (double x, double y) {
+        return std::fabs(x) < std::fabs(y);
+    });
+
+    double n = d.size();
+    double positiveRankSum = 0;
+    double ties = 0;
+
+    for (size_t i = 0; i < d.size(); ) {
+        size_t j = i;
+        while (j < d.size() && std::fabs(d[j]) == std::fabs(d[i])) ++j;
+
+        double rank = (i + j + 1) / 2.0;
+        for (size_t k = i; k < j; ++k) {
+            if (d[k] > 0) positiveRankSum += rank;
+        }
+
+        double t = j - i;
+        ties += t * t * t - t;
+        i = j;
+    }
+
+    double sigma = std::sqrt(n * (n + 1) * (2 * n + 1) / 24 - ties / 48);
+    if (sigma == 0) return 1;
+
+    double z = (positiveRankSum - n * (n + 1) / 4 + 0.5) / sigma;
+    return 0.5 * std::erfc(-z / std::sqrt(2));
+}
+
+// sorted values of statistic(a, b) over bootstrap resamples of a and b
+static std::vector<double> bootstrap(
+    const std::vector<double> &a,
+    const std::vector<double> &b,
+    const std::function<double(const std::vector<double> &, const std::vector<double> &)> &statistic,
+    bool paired,
+    size_t resamples
+) {
+    std::mt19937_64 rng(0x5eed);
+    std::uniform_int_distribution<size_t> pickA(0, a.size() - 1);
+    std::uniform_int_distribution<size_t> pickB(0, b.size() - 1);
+
+    std::vector<double> ra(a.size());
+    std::vector<double> rb(b.size());
+    std::vector<double> stats(resamples);
+
+    for (size_t i = 0; i < resamples; ++i) {
+        if (paired) {
+            for (size_t j = 0; j < ra.size() && j < rb.size(); ++j) {
+                size_t k = pickA(rng);
+                ra[j] = a[k];
+                rb[j] = b[k];
+            }
+        }
+        else {
+            for (auto &x : ra) x = a[pickA(rng)];
+            for (auto &x : rb) x = b[pickB(rng)];
+        }
+        stats[i] = statistic(ra, rb);
+    }
+
+    std::sort(stats.begin(), stats.end());
+
+    return stats;
+}
+
+double dtest::bootstrapUpperBound(
+    const std::vector<double> &a,
+    const std::vector<double> &b,
+    const std::function<double(const std::vector<double> &, const std::vector<double> &)> &statistic,
+    double confidence,
+    bool paired,
+    size_t resamples
+) {
+    return percentile(bootstrap(a, b, statistic, paired, resamples), confidence);
+}
+
+std::pair<double, double> dtest::bootstrapInterval(
+    const std::vector<double> &a,
+    const std::vector<double> &b,
+    const std::function<double(const std::vector<double> &, const std::vector<double> &)> &statistic,
+    double confidence,
+    bool paired,
+    size_t resamples
+) {
+    auto stats = bootstrap(a, b, statistic, paired, resamples);
+    return {
+        percentile(stats, (1 - confidence) / 2),
+        percentile(stats, (1 + confidence) / 2)
+    };
+}
+
+double dtest::mean(const std::vector<double> &x) {
+    double sum = 0;
+    for (auto v : x) sum += v;
+    return x.empty() ? 0 : sum / x.size();
+}
+
+std::string dtest::toString(Complexity complexity) {
+    switch (complexity) {
+    case Complexity::O_1:       return "O(1)";
+    case Complexity::LOG_N:     return "O(log n)";
+    case Complexity::N:         return "O(n)";
+    case Complexity::N_LOG_N:   return "O(n log n)";
+    case Complexity::N_SQUARED: return "O(n^2)";
+    case Complexity::N_CUBED:   return "O(n^3)";
+    }
+    return "";
+}
+
+static double growth(Complexity complexity, double n) {
+    switch (complexity) {
+    case Complexity::O_1:       return 1;
+    case Complexity::LOG_N:     return std::log2(n);
+    case Complexity::N:         return n;
+    case Complexity::N_LOG_N:   return n * std::log2(n);
+    case Complexity::N_SQUARED: return n * n;
+    case Complexity::N_CUBED:   return n * n * n;
+    }
+    return 1;
+}
+
+ComplexityFit dtest::fitComplexity(const std::vector<uint64_t> &n, const std::vector<double> &t) {
+    static const Complexity classes[] = {
+        Complexity::O_1,
+        Complexity::LOG_N,
+        Complexity::N,
+        Complexity::N_LOG_N,
+        Complexity::N_SQUARED,
+        Complexity::N_CUBED,
+    };
+
+    ComplexityFit best;
+    best.rms = -1;
+
+    double average = mean(t);
+    if (n.empty() || n.size() != t.size() || average == 0) return ComplexityFit();
+
+    for (auto c : classes) {
+        double ft = 0, ff = 0;
+        for (size_t i = 0; i < n.size(); ++i) {
+            double f = growth(c, n[i]);
+            ft += f * t[i];
+            ff += f * f;
+        }
+        if (ff == 0) continue;
+
+        double coefficient = ft / ff;
+
+        double error = 0;
+        for (size_t i = 0; i < n.size(); ++i) {
+            double e = t[i] - coefficient * growth(c, n[i]);
+            error += e * e;
+        }
+        double rms = std::sqrt(error / n.size()) / average;
+
+        if (best.rms < 0 || rms < best.rms) {
+            best.complexity = c;
+            best.coefficient = coefficient;
+            best.rms = rms;
+        }
+    }
+
+    return best;
+}
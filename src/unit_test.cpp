@@ -11,18 +11,41 @@ using namespace dtest;
 
 void UnitTest::_configure() {
     sandbox().disableFaultyNetwork();
+    sandbox().memoryLimits(_memoryBytesLimit, _memoryBlocksLimit);
+
+    Memory::ProfileOptions profile;
+    profile.timeline = _memoryTimelineTopN > 0;
+    profile.histograms = _allocationHistogramsTopN > 0;
+    profile.overhead = _allocatorOverhead;
+    profile.crossThreadFrees = _crossThreadFreesTopN > 0;
+    sandbox().memoryProfileOptions(profile);
+    useAllocator(Allocator::LIBC);     // in case a previous in-process body threw
 }
 
 void UnitTest::_checkMemoryLeak() {
-    if (
-        ! _ignoreMemoryLeak
-        && _usedResources.memory.allocate.size > _usedResources.memory.deallocate.size
-    ) {
+    const auto &memory = _usedResources.memory;
+
+    bool leak = false;
+    size_t size = 0;
+    size_t count = 0;
+
+    if (memory.allocate.size > memory.deallocate.size) {
+        leak = true;
+        size += memory.allocate.size - memory.deallocate.size;
+        count += memory.allocate.count - memory.deallocate.count;
+    }
+
+    if (memory.poolAllocate.count > memory.poolDeallocate.count) {
+        leak = true;
+        size += memory.poolAllocate.size - memory.poolDeallocate.size;
+        count += memory.poolAllocate.count - memory.poolDeallocate.count;
+    }
+
+    if (! _ignoreMemoryLeak && leak) {
         _status = Status::PASS_WITH_MEMORY_LEAK;
         err(
             "WARNING - possible memory leak detected: "
-            + formatSize(_usedResources.memory.allocate.size - _usedResources.memory.deallocate.size) + " ("
-            + std::to_string(_usedResources.memory.allocate.count - _usedResources.memory.deallocate.count)
+            + formatSize(size) + " (" + std::to_string(count)
             + " block(s)) difference." + sandbox().memoryReport()
         );
     }
@@ -35,6 +58,14 @@ void UnitTest::_checkMemoryLeak() {
         );
     }
 
+    if (_stackProfile && sandbox().maxStackUsage() > _stackBytesLimit) {
+        _status = Status::MEMORY_LIMIT_EXCEEDED;
+        err(
+            "WARNING - exceeded stack limit of " + formatSize(_stackBytesLimit)
+            + ", peak stack usage was " + formatSize(sandbox().maxStackUsage())
+        );
+    }
+
     if (_usedResources.memory.max.count > _memoryBlocksLimit) {
         _status = Status::MEMORY_LIMIT_EXCEEDED;
         err(
@@ -51,6 +82,62 @@ void UnitTest::_checkTimeout(uint64_t time) {
     }
 }
 
+void UnitTest::_profileMemory() {
+    std::stringstream s;
+
+    if (_heapProfileTopN > 0) {
+        s << "\"profile\": {\n" << indent(sandbox().memoryProfile(_heapProfileTopN), 2) << "\n}";
+    }
+
+    if (_memoryTimelineTopN > 0) {
+        if (s.tellp() > 0) s << ",\n";
+        s << sandbox().memoryTimeline(_memoryTimelineTopN);
+    }
+
+    if (_allocationHistogramsTopN > 0) {
+        if (s.tellp() > 0) s << ",\n";
+        s << sandbox().memoryHistograms(_allocationHistogramsTopN);
+    }
+
+    if (_allocatorOverhead) {
+        if (s.tellp() > 0) s << ",\n";
+        s << sandbox().memoryOverhead();
+    }
+
+    if (_crossThreadFreesTopN > 0) {
+        if (s.tellp() > 0) s << ",\n";
+        s << sandbox().memoryCrossThreadFrees(_crossThreadFreesTopN);
+    }
+
+    if (_stackProfile) {
+        if (s.tellp() > 0) s << ",\n";
+        s << sandbox().stackProfile();
+    }
+
+    if (_workingSet) {
+        if (s.tellp() > 0) s << ",\n";
+        s << sandbox().workingSet();
+    }
+
+    auto pools = sandbox().memoryPools();
+    if (! pools.empty()) {
+        if (s.tellp() > 0) s << ",\n";
+        s << pools;
+    }
+
+    _memoryProfile = s.str();
+
+    if (! _heapProfileExport.empty()) {
+        sandbox().exportMemoryProfile(_heapProfileExport);
+    }
+}
+
+void UnitTest::_runBody() {
+    _bodyAllocations = sandbox().memoryAllocationCount();
+    _bodyTime = timeOf(_body);
+    _bodyAllocations = sandbox().memoryAllocationCount() - _bodyAllocations;
+}
+
 void UnitTest::_driverRun() {
     auto opt = Sandbox::Options();
     opt.fork(! _inProcessSandbox);
@@ -60,6 +147,7 @@ void UnitTest::_driverRun() {
         _timeout < 2000000000lu ? 2000000000lu : _timeout,
         [this] {
             _configure();
+            if (_counters) sandbox().openCounters();
 
             _status = Status::FAIL;
 
@@ -67,32 +155,50 @@ void UnitTest::_driverRun() {
             _initTime = timeOf(_onInit);
 
             if (_resourceSnapshotBodyOnly) sandbox().resourceSnapshot(_usedResources);
-            _bodyTime = timeOf(_body);
+            if (_stackProfile) sandbox().startStackProfile();
+            if (_workingSet) sandbox().startWorkingSet();
+            useAllocator(_allocator);
+            _runBody();
+            useAllocator(Allocator::LIBC);
+            if (_workingSet) sandbox().stopWorkingSet();
+            if (_stackProfile) sandbox().stopStackProfile();
             if (_resourceSnapshotBodyOnly) sandbox().resourceSnapshot(_usedResources);
 
             _completeTime = timeOf(_onComplete);
             if (! _resourceSnapshotBodyOnly) sandbox().resourceSnapshot(_usedResources);
+            sandbox().closeCounters();
 
             _status = Status::PASS;
         },
         [this] (Message &m) {
             _checkMemoryLeak();
             _checkTimeout(_bodyTime);
+            _profileMemory();
 
             m << _status
                 << _usedResources
                 << _errors
+                << _memoryProfile
                 << _initTime
                 << _bodyTime
+                << _bodySamples
+                << _bodyAllocations
                 << _completeTime;
+
+            _sendBodyResults(m);
         },
         [this] (Message &m) {
             m >> _status
                 >> _usedResources
                 >> _errors
+                >> _memoryProfile
                 >> _initTime
                 >> _bodyTime
+                >> _bodySamples
+                >> _bodyAllocations
                 >> _completeTime;
+
+            _recvBodyResults(m);
         },
         [this] (const std::string &error) {
             _status = Status::FAIL;
@@ -104,12 +210,16 @@ void UnitTest::_driverRun() {
     _out = std::move(opt.output());
     _err = std::move(opt.error());
 
+    if (opt.fatalError() == FatalError::MEMORY_LIMIT_EXCEEDED) _status = Status::MEMORY_LIMIT_EXCEEDED;
     if (! finish) _status = Status::TIMEOUT;
 }
 
 bool UnitTest::_hasMemoryReport() {
+    // the profile sections (e.g. stack or working set) are reported even when
+    // the test did not allocate
     return _usedResources.memory.allocate.size > 0
-    || _usedResources.memory.deallocate.size > 0;
+    || _usedResources.memory.deallocate.size > 0
+    || ! _memoryProfile.empty();
 }
 
 std::string UnitTest::_memoryReport() {
@@ -141,6 +251,11 @@ std::string UnitTest::_memoryReport() {
         s << "\n}";
     }
 
+    if (! _memoryProfile.empty()) {
+        if (s.tellp() > 0) s << ",\n";
+        s << _memoryProfile;
+    }
+
     return s.str();
 }
 
@@ -163,6 +278,10 @@ void UnitTest::_report(bool driver, std::stringstream &s) {
         s << ",\n\"memory\": {\n" << indent(_memoryReport(), 2) << "\n}";
     }
 
+    if (_usedResources.counters.valid) {
+        s << ",\n\"counters\": {\n" << indent(_usedResources.counters.report(), 2) << "\n}";
+    }
+
     if (_out.size() > 0) {
         s << ",\n\"stdout\": \n" << indent(jsonify(std::string((const char *) _out.data(), _out.size())), 2);
     }
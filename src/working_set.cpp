@@ -0,0 +1,84 @@
+/*
+ * Copyright (c) 2021 Noah Orensa.
+ * Licensed under the MIT license. See LICENSE file in the project root for details.
+*/
+
+#include <dtest_core/working_set.h>
+#include <dtest_core/sandbox.h>
+#include <sys/resource.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <string.h>
+#include <sstream>
+
+using namespace dtest;
+
+// sums the given fields over all mappings. smaps_rollup holds a single entry
+// with the totals, while smaps holds one per mapping.
+bool WorkingSet::_readSmaps(const char *path, Usage &usage) {
+    FILE *f = fopen(path, "r");
+    if (f == nullptr) return false;
+
+    char line[256];
+    size_t kb;
+
+    while (fgets(line, sizeof(line), f) != nullptr) {
+        if (sscanf(line, "Referenced: %zu kB", &kb) == 1) usage.referenced += kb * 1024;
+        else if (sscanf(line, "Rss: %zu kB", &kb) == 1) usage.rss += kb * 1024;
+        else if (sscanf(line, "AnonHugePages: %zu kB", &kb) == 1) usage.anonHugePages += kb * 1024;
+    }
+
+    fclose(f);
+    return true;
+}
+
+void WorkingSet::start() {
+    sandbox().lock();
+
+    _usage = Usage();
+
+    int fd = open("/proc/self/clear_refs", O_WRONLY);
+    _cleared = fd != -1 && write(fd, "1", 1) == 1;
+    if (fd != -1) close(fd);
+
+    struct rusage r;
+    getrusage(RUSAGE_SELF, &r);
+    _minorFaults = r.ru_minflt;
+    _majorFaults = r.ru_majflt;
+
+    sandbox().unlock();
+}
+
+void WorkingSet::stop() {
+    sandbox().lock();
+
+    struct rusage r;
+    getrusage(RUSAGE_SELF, &r);
+    _usage.minorFaults = r.ru_minflt - _minorFaults;
+    _usage.majorFaults = r.ru_majflt - _majorFaults;
+
+    bool ok = _readSmaps("/proc/self/smaps_rollup", _usage)
+        || _readSmaps("/proc/self/smaps", _usage);
+    _usage.referencedValid = ok && _cleared;
+
+    sandbox().unlock();
+}
+
+std::string WorkingSet::report() const {
+    std::stringstream s;
+
+    s << "\"workingSet\": {";
+    if (_usage.referencedValid) {
+        s << "\n  \"referenced\": " << _usage.referenced << ",";
+    }
+    s << "\n  \"rss\": " << _usage.rss;
+    s << ",\n  \"anonHugePages\": " << _usage.anonHugePages;
+    s << ",\n  \"faults\": {";
+    s << "\n    \"minor\": " << _usage.minorFaults;
+    s << ",\n    \"major\": " << _usage.majorFaults;
+    s << "\n  }";
+    s << "\n}";
+
+    return s.str();
+}
@@ -0,0 +1,97 @@
+/*
+ * Copyright (c) 2021 Noah Orensa.
+ * Licensed under the MIT license. See LICENSE file in the project root for details.
+*/
+
+#include <dtest.h>
+#include <chrono>
+#include <atomic>
+#include <future>
+#include <algorithm>
+
+module("load-test")
+.dependsOn({
+    "unit-test"
+});
+
+// busy waits, so that the service time does not depend on the scheduler
+static void serve(uint64_t micros) {
+    auto end = std::chrono::steady_clock::now() + std::chrono::microseconds(micros);
+    while (std::chrono::steady_clock::now() < end);
+}
+
+loadTest("load-test", "constant-rate")
+.rate(500)
+.arrivals(dtest::Arrivals::CONSTANT)
+.durationMillis(200)
+.minSaturationRate(500)
+.body([] {
+    serve(100);
+});
+
+loadTest("load-test", "poisson-sweep")
+.rates({200, 2000})
+.durationMillis(200)
+.body([] {
+    serve(1000);
+});
+
+loadTest("load-test", "generators")
+.rate(1000)
+.generators(2)
+.durationMillis(200)
+.ignoreMemoryLeak()
+.body([] {
+    serve(100);
+});
+
+static std::atomic<size_t> sends(0);
+static uint64_t sendTimes[1000];
+
+loadTest("load-test", "constant-generators")
+.rate(1000)
+.arrivals(dtest::Arrivals::CONSTANT)
+.generators(2)
+.durationMillis(200)
+.ignoreMemoryLeak()
+.body([] {
+    size_t i = sends++;
+    if (i < 1000) {
+        sendTimes[i] = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()
+        ).count();
+    }
+})
+.onComplete([] {
+    // the generators are staggered, so requests are not sent in pairs
+    size_t n = sends < 1000 ? sends.load() : 1000;
+    std::sort(sendTimes, sendTimes + n);
+
+    size_t bursts = 0;
+    for (size_t i = 1; i < n; ++i) {
+        if (sendTimes[i] - sendTimes[i - 1] < 250000) ++bursts;
+    }
+    assert(n > 100);
+    assert(bursts < n / 4);
+});
+
+loadTest("load-test", "saturated")
+.expect(Status::TOO_SLOW)
+.rates({200, 2000})
+.arrivals(dtest::Arrivals::CONSTANT)
+.durationMillis(200)
+.minSaturationRate(5000)
+.body([] {
+    serve(1000);
+});
+
+// load is a common identifier, e.g. of std::atomic, and must not be taken
+// over by dtest.h
+unit("load-test", "load-identifier")
+.body([] {
+    std::atomic<int> counter(1);
+    assert(counter.load() == 1);
+
+    auto f = std::async(std::launch::deferred, [] { return 2; });
+    assert(f.get() == 2);
+});
@@ -4,6 +4,10 @@
 */
 
 #include <dtest.h>
+#include <vector>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
 
 module("performance-test")
 .dependsOn({
@@ -55,3 +59,309 @@ perf("performance-test", "error-msg")
 .baseline([] {
     err("error from baseline");
 });
+
+perf("performance-test", "max-allocations-per-body")
+.maxAllocationsPerBody(10)
+.body([] {
+    for (int i = 0; i < 10; ++i) delete new int;
+    for (int i = 0; i < 1000000; ++i);
+})
+.baseline([] {
+    for (int i = 0; i < 100; ++i) delete new int;
+    for (int i = 0; i < 8000000; ++i);
+});
+
+perf("performance-test", "too-many-allocations-per-body")
+.expect(Status::TOO_SLOW)
+.maxAllocationsPerBody(10)
+.body([] {
+    for (int i = 0; i < 11; ++i) delete new int;
+    for (int i = 0; i < 1000000; ++i);
+})
+.baseline([] {
+    for (int i = 0; i < 8000000; ++i);
+});
+
+// maps 100k regions, trimming each at both ends and splitting it in the middle
+template <typename Map, typename Unmap>
+static void mmapChurn(Map map, Unmap unmap) {
+    const size_t sz = getpagesize();
+    const size_t n = 10000;
+    std::vector<char *> regions(n);
+
+    for (auto round = 0; round < 10; ++round) {
+        for (size_t i = 0; i < n; ++i) regions[i] = map(5 * sz);
+        for (size_t i = 0; i < n; ++i) unmap(regions[i] + 2 * sz, sz);
+        for (size_t i = 0; i < n; ++i) unmap(regions[i] + sz, sz);
+        for (size_t i = 0; i < n; ++i) unmap(regions[i] + 3 * sz, sz);
+        for (size_t i = 0; i < n; ++i) unmap(regions[i], sz);
+        for (size_t i = 0; i < n; ++i) unmap(regions[i] + 4 * sz, sz);
+    }
+}
+
+perf("performance-test", "mmap-churn")
+.performanceMarginAsBaselineRatio(4)
+.body([] {
+    mmapChurn(
+        [] (size_t size) {
+            return (char *) mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        },
+        [] (char *ptr, size_t size) {
+            munmap(ptr, size);
+        }
+    );
+})
+.baseline([] {
+    // bypasses the memory hooks
+    mmapChurn(
+        [] (size_t size) {
+            return (char *) syscall(SYS_mmap, nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        },
+        [] (char *ptr, size_t size) {
+            syscall(SYS_munmap, ptr, size);
+        }
+    );
+});
+
+perf("performance-test", "repetitions")
+.repetitions(10)
+.warmup(2)
+.body([] {
+    for (int i = 0; i < 1000000; ++i);
+})
+.baseline([] {
+    for (int i = 0; i < 8000000; ++i);
+});
+
+perf("performance-test", "repetitions-too-slow")
+.repetitions(10)
+.expect(Status::TOO_SLOW)
+.body([] {
+    for (int i = 0; i < 8000000; ++i);
+})
+.baseline([] {
+    for (int i = 0; i < 1000000; ++i);
+});
+
+perf("performance-test", "repetitions-bootstrap")
+.repetitions(10)
+.significance(dtest::Significance::BOOTSTRAP, 0.01)
+.performanceMarginAsBaselineRatio(0.7)
+.body([] {
+    for (int i = 0; i < 1000000; ++i);
+})
+.baseline([] {
+    for (int i = 0; i < 8000000; ++i);
+});
+
+perf("performance-test", "min-time")
+.minTimeMillis(50)
+.body([] {
+    for (int i = 0; i < 1000000; ++i);
+})
+.baseline([] {
+    for (int i = 0; i < 8000000; ++i);
+});
+
+// samples of a body no costlier than the loop overhead are 0, and must not
+// keep the minimum time from being reached
+perf("performance-test", "min-time-free-body")
+.minTimeMillis(20)
+.microBody([] (uint64_t n) {
+    for (uint64_t i = 0; i < n; ++i) dtest_do_not_optimize(i);
+})
+.microBaseline([] (uint64_t n) {
+    for (uint64_t i = 0; i < n; ++i) {
+        uint64_t x = i;
+        for (int j = 0; j < 50; ++j) {
+            x = x * 31 + j;
+            dtest_do_not_optimize(x);
+        }
+    }
+});
+
+perf("performance-test", "microbenchmark")
+.repetitions(5)
+.microBody([] (uint64_t n) {
+    for (uint64_t i = 0; i < n; ++i) {
+        uint64_t x = i * 3;
+        dtest_do_not_optimize(x);
+    }
+})
+.microBaseline([] (uint64_t n) {
+    for (uint64_t i = 0; i < n; ++i) {
+        uint64_t x = i;
+        for (int j = 0; j < 50; ++j) {
+            x = x * 31 + j;
+            dtest_do_not_optimize(x);
+        }
+    }
+});
+
+perf("performance-test", "microbenchmark-too-slow")
+.repetitions(5)
+.expect(Status::TOO_SLOW)
+.microBody([] (uint64_t n) {
+    int a[64];
+    for (uint64_t i = 0; i < n; ++i) {
+        for (int j = 0; j < 64; ++j) a[j] = i + j;
+        dtest_do_not_optimize(a);
+    }
+})
+.microBaseline([] (uint64_t n) {
+    for (uint64_t i = 0; i < n; ++i) dtest_clobber_memory();
+});
+
+perf("performance-test", "interleaved")
+.repetitions(10)
+.interleave()
+.body([] {
+    for (int i = 0; i < 1000000; ++i);
+})
+.baseline([] {
+    for (int i = 0; i < 8000000; ++i);
+});
+
+perf("performance-test", "interleaved-random-too-slow")
+.repetitions(10)
+.interleave(dtest::Interleave::RANDOM)
+.flushCaches()
+.expect(Status::TOO_SLOW)
+.body([] {
+    for (int i = 0; i < 8000000; ++i);
+})
+.baseline([] {
+    for (int i = 0; i < 1000000; ++i);
+});
+
+perf("performance-test", "interleaved-microbenchmark")
+.repetitions(5)
+.interleave()
+.significance(dtest::Significance::BOOTSTRAP)
+.microBody([] (uint64_t n) {
+    for (uint64_t i = 0; i < n; ++i) dtest_clobber_memory();
+})
+.microBaseline([] (uint64_t n) {
+    int a[64];
+    for (uint64_t i = 0; i < n; ++i) {
+        for (int j = 0; j < 64; ++j) a[j] = i + j;
+        dtest_do_not_optimize(a);
+    }
+});
+
+perf("performance-test", "variants")
+.repetitions(5)
+.variant("slow", [] {
+    for (int i = 0; i < 8000000; ++i) dtest_do_not_optimize(i);
+})
+.variant("medium", [] {
+    for (int i = 0; i < 4000000; ++i) dtest_do_not_optimize(i);
+})
+.variant("fast", [] {
+    for (int i = 0; i < 1000000; ++i) dtest_do_not_optimize(i);
+})
+.expectFaster("fast", "slow", 2)
+.expectFaster("medium", "slow");
+
+perf("performance-test", "variants-too-slow")
+.repetitions(5)
+.expect(Status::TOO_SLOW)
+.variant("slow", [] {
+    for (int i = 0; i < 8000000; ++i) dtest_do_not_optimize(i);
+})
+.variant("fast", [] {
+    for (int i = 0; i < 1000000; ++i) dtest_do_not_optimize(i);
+})
+.expectFaster("slow", "fast");
+
+perf("performance-test", "variants-unknown")
+.expect(Status::FAIL)
+.variant("a", [] { })
+.expectFaster("a", "b");
+
+static uint64_t paramSize = 0;
+
+perf("performance-test", "params")
+.params({1e5, 3e5, 1e6, 3e6})
+.repetitions(3)
+.expectComplexity(dtest::Complexity::N_LOG_N)
+.onInit([] (uint64_t n) {
+    paramSize = n;
+})
+.body([] (uint64_t n) {
+    assert(n == paramSize);
+    for (uint64_t i = 0; i < n; ++i) dtest_do_not_optimize(i);
+})
+.baseline([] (uint64_t n) {
+    assert(n == paramSize);
+    for (uint64_t i = 0; i < 8 * n; ++i) dtest_do_not_optimize(i);
+});
+
+perf("performance-test", "params-complexity-too-high")
+.params({500, 1000, 2000, 4000})
+.expect(Status::TOO_SLOW)
+.expectComplexity(dtest::Complexity::N_LOG_N)
+.body([] (uint64_t n) {
+    for (uint64_t i = 0; i < n; ++i) {
+        for (uint64_t j = 0; j < n; ++j) dtest_do_not_optimize(j);
+    }
+})
+.baseline([] {
+    for (int i = 0; i < 100; ++i);
+});
+
+perf("performance-test", "latency")
+.percentileBelowMillis(99, 100)
+.body([] {
+    for (int i = 0; i < 1000; ++i) {
+        dtest_time_latency {
+            for (int j = 0; j < 1000; ++j);
+        }
+    }
+    dtest_record_latency(50);
+})
+.baseline([] {
+    for (int i = 0; i < 8000000; ++i);
+});
+
+perf("performance-test", "counters")
+.counters()
+.repetitions(5)
+.body([] {
+    for (int i = 0; i < 1000000; ++i);
+})
+.baseline([] {
+    for (int i = 0; i < 8000000; ++i);
+});
+
+perf("performance-test", "instructions")
+.metric(dtest::Metric::INSTRUCTIONS)
+.repetitions(5)
+.body([] {
+    for (int i = 0; i < 1000000; ++i);
+})
+.baseline([] {
+    for (int i = 0; i < 8000000; ++i);
+});
+
+perf("performance-test", "instructions-repetitions-too-slow")
+.expect(Status::TOO_SLOW)
+.metric(dtest::Metric::INSTRUCTIONS)
+.repetitions(10)
+.body([] {
+    for (int i = 0; i < 8000000; ++i);
+})
+.baseline([] {
+    for (int i = 0; i < 1000000; ++i);
+});
+
+perf("performance-test", "latency-too-slow")
+.expect(Status::TOO_SLOW)
+.repetitions(20)
+.percentileBelowNanos(50, 1000)
+.body([] {
+    for (int i = 0; i < 1000000; ++i);
+})
+.baseline([] {
+    for (int i = 0; i < 8000000; ++i);
+});
@@ -0,0 +1,85 @@
+/*
+ * Copyright (c) 2021 Noah Orensa.
+ * Licensed under the MIT license. See LICENSE file in the project root for details.
+*/
+
+#include <dtest.h>
+#include <thread>
+#include <vector>
+#include <mutex>
+
+module("scaling-test")
+.dependsOn({
+    "unit-test"
+});
+
+// splits a fixed amount of work among the threads
+static void work(size_t threads, uint64_t total) {
+    std::vector<std::thread> pool;
+    for (size_t t = 0; t < threads; ++t) {
+        pool.emplace_back([threads, total] {
+            for (uint64_t i = 0; i < total / threads; ++i) dtest_do_not_optimize(i);
+        });
+    }
+    for (auto &t : pool) t.join();
+}
+
+scalingTest("scaling-test", "sweep")
+.threads({1, 2, 4})
+.repetitions(3)
+.ignoreMemoryLeak()
+.minEfficiency(2, 0.2)
+.body([] (size_t threads) {
+    work(threads, 20000000);
+});
+
+scalingTest("scaling-test", "default-sweep")
+.maxThreads(2)
+.ompThreads()
+.ignoreMemoryLeak()
+.body([] (size_t threads) {
+    assert(threads == 1 || threads == 2);
+    work(threads, 1000000);
+});
+
+scalingTest("scaling-test", "serialized")
+.expect(Status::TOO_SLOW)
+.threads({1, 4})
+.ignoreMemoryLeak()
+.minEfficiency(4, 0.5)
+.body([] (size_t threads) {
+    static std::mutex mtx;
+    std::vector<std::thread> pool;
+    for (size_t t = 0; t < threads; ++t) {
+        pool.emplace_back([] {
+            std::lock_guard<std::mutex> lock(mtx);
+            for (uint64_t i = 0; i < 5000000; ++i) dtest_do_not_optimize(i);
+        });
+    }
+    for (auto &t : pool) t.join();
+});
+
+scalingTest("scaling-test", "not-in-sweep")
+.expect(Status::FAIL)
+.threads({1, 2})
+.ignoreMemoryLeak()
+.minEfficiency(3, 0.5)
+.body([] (size_t threads) {
+    work(threads, 1000);
+});
+
+// scale is a common identifier, and must not be taken over by dtest.h
+struct Point {
+    double x;
+
+    void scale(double factor) {
+        x *= factor;
+    }
+};
+
+unit("scaling-test", "scale-identifier")
+.body([] {
+    Point p { 2 };
+    p.scale(3);
+    assert(p.x == 6);
+});
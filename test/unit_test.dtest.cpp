@@ -6,9 +6,33 @@
 #include <dtest.h>
 #include <iostream>
 #include <thread>
+#include <vector>
+#include <stdexcept>
+#include <fstream>
+#include <cstdlib>
+#include <cstring>
 #include <sys/mman.h>
+#include <malloc.h>
 #include <unistd.h>
 
+// first number that follows "key": in a JSON report
+static double jsonNumber(const std::string &json, const std::string &key) {
+    auto pos = json.find("\"" + key + "\": ");
+    assert(pos != std::string::npos);
+    return strtod(json.c_str() + pos + key.size() + 4, nullptr);
+}
+
+// the memory reports are built with tracking disabled, so they are checked
+// and released before tracking resumes
+static void checkReport(
+    const std::function<std::string ()> &report,
+    const std::function<void (const std::string &)> &check
+) {
+    dtest::sandbox().lock();
+    check(report());
+    dtest::sandbox().unlock();
+}
+
 unit("root-test")
 .body([] {
 });
@@ -76,6 +100,16 @@ unit("unit-test", "mmap-mem-leak")
     #pragma GCC diagnostic ignored "-Wunused-result"
     mmap(nullptr, sz, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
     #pragma GCC diagnostic pop
+})
+.onComplete([] {
+    // the leaked region is reported as a block
+    checkReport(
+        [] { return dtest::sandbox().memoryReport(); },
+        [] (const std::string &report) {
+            assert(report.find("\n1 block(s), ") != std::string::npos);
+            assert(report.find("0 block(s)") == std::string::npos);
+        }
+    );
 });
 
 unit("unit-test", "invalid-munmap")
@@ -109,6 +143,26 @@ unit("unit-test", "mmap-mremap")
     mremap(ptr, sz, sz * 2, MREMAP_MAYMOVE);
 });
 
+unit("unit-test", "mmap-churn")
+.body([] {
+    const size_t sz = getpagesize();
+    const size_t n = 10000;
+    std::vector<char *> regions(n);
+
+    // 100k mappings, each trimmed at both ends, split in the middle, then unmapped
+    for (auto round = 0; round < 10; ++round) {
+        for (size_t i = 0; i < n; ++i) {
+            regions[i] = (char *) mmap(nullptr, 5 * sz, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            assert(regions[i] != MAP_FAILED);
+        }
+        for (size_t i = 0; i < n; ++i) assert(munmap(regions[i] + 2 * sz, sz) == 0);
+        for (size_t i = 0; i < n; ++i) assert(munmap(regions[i] + sz, sz) == 0);
+        for (size_t i = 0; i < n; ++i) assert(munmap(regions[i] + 3 * sz, sz) == 0);
+        for (size_t i = 0; i < n; ++i) assert(munmap(regions[i], sz) == 0);
+        for (size_t i = 0; i < n; ++i) assert(munmap(regions[i] + 4 * sz, sz) == 0);
+    }
+});
+
 unit("unit-test", "error-message")
 .body([] {
     err("error");
@@ -321,6 +375,25 @@ unit("unit-test", "memory-blocks-limit-fail")
     free(p2);
 });
 
+unit("unit-test", "memory-bytes-limit-stops-body")
+.memoryBytesLimit(16 * 1024 * 1024)
+.expect(Status::MEMORY_LIMIT_EXCEEDED)
+.body([] {
+    std::vector<void *> blocks;
+    for (auto i = 0; i < 1024; ++i) blocks.push_back(malloc(1024 * 1024));
+
+    throw std::runtime_error("memory limit was not enforced during the test body");
+});
+
+unit("unit-test", "memory-blocks-limit-stops-body")
+.memoryBlocksLimit(1000)
+.expect(Status::MEMORY_LIMIT_EXCEEDED)
+.body([] {
+    for (auto i = 0; i < 100000; ++i) new int;
+
+    throw std::runtime_error("memory limit was not enforced during the test body");
+});
+
 unit("unit-test", "memory-leak-in-onInit-1")
 .expect(Status::PASS_WITH_MEMORY_LEAK)
 .onInit([] {
@@ -342,3 +415,720 @@ unit("unit-test", "memory-leak-in-onInit-2")
 })
 .body([] {
 });
+
+// the folded stack of the heaviest site, and its value
+static std::pair<std::string, size_t> topFoldedStack(const std::string &path) {
+    std::ifstream in(path);
+    std::pair<std::string, size_t> top;
+
+    std::string line;
+    while (std::getline(in, line)) {
+        auto space = line.rfind(' ');
+        size_t value = strtoul(line.c_str() + space + 1, nullptr, 10);
+        if (value > top.second) top = { line.substr(0, space), value };
+    }
+
+    return top;
+}
+
+unit("unit-test", "heap-profile")
+.expect(Status::PASS_WITH_MEMORY_LEAK)
+.heapProfile(5)
+.body([] {
+    for (auto i = 0; i < 50; ++i) {
+        #pragma GCC diagnostic push
+        #pragma GCC diagnostic ignored "-Wunused-result"
+        malloc(1);
+        #pragma GCC diagnostic pop
+    }
+
+    auto ptr = new int[16];
+    delete[] ptr;
+})
+.onComplete([] {
+    // the top site is the malloc loop of the body, which is a frame of this
+    // module
+    checkReport(
+        [] { return dtest::sandbox().memoryProfile(5); },
+        [] (const std::string &report) {
+            auto object = report.find("unit_test.dtest.so");
+            assert(object != std::string::npos && object < report.find("\"callstack\""));
+            assert(jsonNumber(report, "size") == 50);
+            assert(jsonNumber(report, "blocks") == 50);
+        }
+    );
+
+    // scoped, so that the export is released before tracking resumes
+    dtest::sandbox().lock();
+    {
+        char dir[] = "/tmp/dtest-heap-XXXXXX";
+        assert(mkdtemp(dir) != nullptr);
+
+        std::string prefix = std::string(dir) + "/heap";
+        dtest::sandbox().exportMemoryProfile(prefix);
+
+        auto live = topFoldedStack(prefix + ".inuse.folded");
+        auto total = topFoldedStack(prefix + ".alloc.folded");
+
+        unlink((prefix + ".inuse.folded").c_str());
+        unlink((prefix + ".alloc.folded").c_str());
+        rmdir(dir);
+
+        // leaf frames come last, so the stack ends in the body
+        assert(live.second == 50);
+        auto leaf = live.first.substr(live.first.rfind(';') + 1);
+        assert(leaf.find("unit_test.dtest.so") != std::string::npos);
+
+        // the freed array is heavier in total bytes
+        assert(total.second == 16 * sizeof(int));
+    }
+    dtest::sandbox().unlock();
+});
+
+unit("unit-test", "memory-timeline")
+.memoryTimeline()
+.resourceSnapshotBodyOnly()
+.body([] {
+    void *ptrs[256];
+
+    for (auto round = 0; round < 4; ++round) {
+        for (auto i = 0; i < 256; ++i) ptrs[i] = malloc(1024);
+        for (auto i = 0; i < 256; ++i) free(ptrs[i]);
+    }
+
+    auto spike = malloc(1 << 20);
+    free(spike);
+})
+.onComplete([] {
+    checkReport(
+        [] { return dtest::sandbox().memoryTimeline(5); },
+        [] (const std::string &report) {
+            assert(jsonNumber(report, "intervalNs") > 0);
+
+            // the spike is the peak, and comes after the rounds
+            auto peak = report.substr(report.find("\"peak\""));
+            assert(jsonNumber(peak, "size") == 1 << 20);
+            assert(jsonNumber(peak, "blocks") == 1);
+            assert(jsonNumber(peak, "timeNs") > 0);
+
+            // the top site at the peak is the spike
+            auto site = peak.substr(peak.find("\"sites\""));
+            assert(jsonNumber(site, "size") == 1 << 20);
+        }
+    );
+});
+
+unit("unit-test", "allocation-histograms")
+.allocationHistograms()
+.body([] {
+    std::vector<void *> longLived;
+
+    for (auto i = 0; i < 1000; ++i) {
+        auto p = malloc(48);
+        free(p);
+
+        if (i % 100 == 0) longLived.push_back(malloc(1 << (i / 100)));
+    }
+
+    for (auto p : longLived) free(p);
+})
+.onComplete([] {
+    checkReport(
+        [] { return dtest::sandbox().memoryHistograms(5); },
+        [] (const std::string &report) {
+            // the 48 byte blocks of the loop fall in the 32 byte bucket
+            auto bucket = report.find("[ 32, ");
+            assert(bucket < report.find("\"lifetime\""));
+            assert(strtoul(report.c_str() + bucket + 6, nullptr, 10) >= 1000);
+
+            // the malloc / free pair of the loop is the first pool candidate
+            auto candidate = report.substr(report.find("\"poolCandidates\""));
+            assert(jsonNumber(candidate, "blocks") == 1000);
+            assert(candidate.find("\"fixedSize\": true") < candidate.find("\"callstack\""));
+            assert(jsonNumber(candidate, "medianSize") == 32);
+            assert(jsonNumber(candidate, "medianLifetimeAllocations") == 0);
+        }
+    );
+});
+
+unit("unit-test", "alloc-budget")
+.body([] {
+    void *p1, *p2;
+
+    dtest_alloc_budget(2, 64) {
+        p1 = malloc(32);
+        p2 = malloc(32);
+    }
+
+    dtest_no_alloc {
+        free(p1);
+        free(p2);
+    }
+});
+
+// run in-process so that the fatal error reaches the body, which checks that
+// it names the budget and carries the call stack of the allocation. The block
+// that exceeded the budget is lost with the exception, and shows as a leak.
+unit("unit-test", "alloc-budget-exceeded")
+.inProcess()
+.expect(Status::PASS_WITH_MEMORY_LEAK)
+.body([] {
+    void *p[3] = { };
+
+    try {
+        dtest_alloc_budget(2, 1024) {
+            for (auto i = 0; i < 3; ++i) p[i] = malloc(32);
+        }
+        fail("budget not enforced");
+    }
+    catch (const dtest::SandboxFatalException &e) {
+        std::string msg = e.what();
+        assert(e.code() == dtest::FatalError::ALLOCATION_BUDGET_EXCEEDED);
+        assert(msg.find("exceeded allocation budget of 2 block(s) and 1.00 KB") != std::string::npos);
+        assert(msg.find("dtest::UnitTest::_runBody()", msg.find("Caused by:\n")) != std::string::npos);
+    }
+    dtest::sandbox().enter();     // the error stopped tracking
+
+    for (auto i = 0; i < 3; ++i) free(p[i]);
+});
+
+unit("unit-test", "alloc-budget-realloc-shrink")
+.body([] {
+    void *p = malloc(64);
+
+    dtest_no_alloc {
+        p = realloc(p, 32);
+    }
+
+    free(p);
+});
+
+unit("unit-test", "alloc-budget-nested")
+.expect(Status::FAIL)
+.body([] {
+    void *p1, *p2;
+
+    dtest_alloc_budget(1, 1024) {
+        p1 = malloc(32);
+
+        dtest_alloc_budget(1, 1024) {
+            p2 = malloc(32);
+        }
+    }
+
+    free(p1);
+    free(p2);
+});
+
+unit("unit-test", "no-alloc-exceeded")
+.inProcess()
+.expect(Status::PASS_WITH_MEMORY_LEAK)
+.body([] {
+    int *p = nullptr;
+
+    try {
+        dtest_no_alloc {
+            p = new int;
+        }
+        fail("no-allocation region not enforced");
+    }
+    catch (const dtest::SandboxFatalException &e) {
+        std::string msg = e.what();
+        assert(e.code() == dtest::FatalError::ALLOCATION_BUDGET_EXCEEDED);
+        assert(msg.find("allocated memory inside a no-allocation region") != std::string::npos);
+        assert(msg.find("dtest::UnitTest::_runBody()", msg.find("Caused by:\n")) != std::string::npos);
+    }
+    dtest::sandbox().enter();     // the error stopped tracking
+
+    delete p;
+});
+
+extern "C" __attribute__((noinline)) void * suppressed_alloc(size_t size) {
+    return malloc(size);
+}
+
+extern "C" __attribute__((noinline)) void suppressed_free(void *ptr) {
+    free(ptr);
+}
+
+static bool loadSuppressions(const std::string &suppressions) {
+    char path[] = "/tmp/dtest-suppressions-XXXXXX";
+    close(mkstemp(path));
+
+    std::ofstream(path) << suppressions;
+
+    std::string error;
+    bool loaded = dtest::Memory::loadSuppressions(path, error);
+    unlink(path);
+
+    return loaded;
+}
+
+unit("unit-test", "suppressions")
+.resourceSnapshotBodyOnly()
+.onInit([] {
+    assert(loadSuppressions(
+        "# allocations from suppressed_alloc are not tracked\n"
+        "alloc suppressed_alloc 0\n"
+        "dealloc suppressed_free\n"
+    ));
+})
+.body([] {
+    suppressed_alloc(64);
+    suppressed_free(suppressed_alloc(64));
+
+    free(malloc(64));
+});
+
+unit("unit-test", "suppressions-object")
+.resourceSnapshotBodyOnly()
+.onInit([] {
+    assert(loadSuppressions("alloc object:unit_test.dtest.so 0\n"));
+})
+.body([] {
+    #pragma GCC diagnostic push
+    #pragma GCC diagnostic ignored "-Wunused-result"
+    malloc(64);
+    #pragma GCC diagnostic pop
+});
+
+unit("unit-test", "suppressions-invalid")
+.body([] {
+    std::string error;
+    assert(! dtest::Memory::loadSuppressions("/nonexistent/dtest.supp", error));
+    assert(! loadSuppressions("free malloc\n"));
+    assert(! loadSuppressions("alloc malloc 1 extra\n"));
+    assert(! loadSuppressions("alloc object:\n"));
+});
+
+// the valid line of a file that fails to load is not kept either
+unit("unit-test", "suppressions-invalid-partial")
+.expect(Status::PASS_WITH_MEMORY_LEAK)
+.onInit([] {
+    assert(! loadSuppressions(
+        "alloc suppressed_alloc 0\n"
+        "free suppressed_free\n"
+    ));
+})
+.body([] {
+    suppressed_alloc(64);
+});
+
+unit("unit-test", "heap-diff")
+.body([] {
+    std::vector<int *> cache;
+    cache.reserve(16);
+
+    for (auto i = 0; i < 4; ++i) {
+        auto a = dtest_heap_snapshot();
+        delete[] new int[64];
+        auto b = dtest_heap_snapshot();
+
+        auto diff = dtest_heap_diff(a, b);
+        if (! diff.empty()) fail(("unexpected heap growth: " + diff.toString()).c_str());
+    }
+
+    auto a = dtest_heap_snapshot();
+    for (auto i = 0; i < 4; ++i) cache.push_back(new int);
+    auto p = malloc(100);
+    auto b = dtest_heap_snapshot();
+    free(p);
+
+    auto diff = dtest_heap_diff(a, b);
+    assert(diff.blocks() == 4);
+    assert(diff.size() == 4 * sizeof(int));
+    assert(diff.sites().size() == 1);
+    assert(diff.sites()[0].blocks == 4);
+
+    auto copy = diff;
+    assert(copy.blocks() == 4);
+
+    for (auto p : cache) delete p;
+});
+
+static char arena[4096];
+
+unit("unit-test", "pool-annotations")
+.body([] {
+    size_t used = 0;
+    dtest_pool_name(arena, "arena");
+
+    for (auto i = 0; i < 4; ++i) {
+        dtest_track_alloc(arena, arena + used, 64);
+        used += 64;
+    }
+    dtest_track_free(arena, arena);
+
+    dtest_pool_reset(arena);
+})
+.onComplete([] {
+    checkReport(
+        [] { return dtest::sandbox().memoryPools(); },
+        [] (const std::string &report) {
+            assert(report.find("\"name\": \"arena\"") != std::string::npos);
+
+            auto live = report.substr(report.find("\"live\""));
+            assert(jsonNumber(live, "size") == 0);
+            assert(jsonNumber(live, "blocks") == 0);
+
+            auto total = report.substr(report.find("\"total\""));
+            assert(jsonNumber(total, "size") == 4 * 64);
+            assert(jsonNumber(total, "blocks") == 4);
+
+            assert(jsonNumber(report, "max") == 4 * 64);
+        }
+    );
+});
+
+unit("unit-test", "pool-annotations-leak")
+.expect(Status::PASS_WITH_MEMORY_LEAK)
+.body([] {
+    dtest_pool_name(arena, "arena");
+    dtest_track_alloc(arena, arena, 64);
+    dtest_track_alloc(arena, arena + 64, 64);
+    dtest_track_free(arena, arena + 64);
+})
+.onComplete([] {
+    // the leak report lists the block left in the pool under its name
+    checkReport(
+        [] { return dtest::sandbox().memoryReport(); },
+        [] (const std::string &report) {
+            assert(report.find("1 block(s), 64 B allocated from pool arena") != std::string::npos);
+        }
+    );
+});
+
+// blocks still live when the body starts, e.g. left by in-process tests
+static dtest::ResourceSnapshot heapArenaStart;
+
+unit("unit-test", "pool-annotations-heap-arena")
+.memoryTimeline()
+.resourceSnapshotBodyOnly()
+.body([] {
+    dtest::sandbox().resourceSnapshot(heapArenaStart);
+
+    // the blocks of an arena carved from the heap are not counted on top of
+    // the arena itself
+    char *heapArena = (char *) malloc(4096);
+    memset(heapArena, 0, 4096);
+    dtest_pool_name(heapArena, "heap-arena");
+
+    for (auto i = 0; i < 4; ++i) dtest_track_alloc(heapArena, heapArena + i * 1024, 1024);
+    dtest_pool_reset(heapArena);
+
+    free(heapArena);
+})
+.onComplete([] {
+    checkReport(
+        [] { return dtest::sandbox().memoryTimeline(5); },
+        [] (const std::string &report) {
+            auto peak = report.substr(report.find("\"peak\""));
+            auto &start = heapArenaStart.memory;
+            assert(jsonNumber(peak, "size") == start.allocate.size - start.deallocate.size + 4096);
+            assert(jsonNumber(peak, "blocks") == start.allocate.count - start.deallocate.count + 1);
+        }
+    );
+});
+
+unit("unit-test", "pool-annotations-no-alloc")
+.expect(Status::FAIL)
+.body([] {
+    dtest_no_alloc {
+        dtest_track_alloc(arena, arena, 64);
+    }
+
+    dtest_track_free(arena, arena);
+});
+
+unit("unit-test", "pool-annotations-invalid-free")
+.expect(Status::FAIL)
+.body([] {
+    dtest_track_alloc(arena, arena, 64);
+    dtest_track_free(arena, arena + 64);
+});
+
+unit("unit-test", "pool-annotations-unknown-pool")
+.expect(Status::FAIL)
+.body([] {
+    static char unknown[64];
+    dtest_track_free(unknown, unknown);
+});
+
+static size_t recurse(size_t depth) {
+    volatile char frame[1024];
+    frame[0] = (char) depth;
+    if (depth == 0) return frame[0];
+    return recurse(depth - 1) + frame[0];
+}
+
+unit("unit-test", "stack-profile")
+.stackBytesLimit(1024 * 1024)
+.ignoreMemoryLeak()     // thread-local storage of the new thread
+.body([] {
+    recurse(64);
+
+    std::thread t([] { recurse(64); });
+    t.join();
+});
+
+unit("unit-test", "stack-profile-no-alloc")
+.stackProfile()
+.resourceSnapshotBodyOnly()
+.body([] {
+    recurse(64);
+});
+
+unit("unit-test", "stack-limit")
+.stackBytesLimit(128 * 1024)
+.expect(Status::MEMORY_LIMIT_EXCEEDED)
+.body([] {
+    recurse(256);
+});
+
+unit("unit-test", "stack-limit-thread")
+.stackBytesLimit(128 * 1024)
+.ignoreMemoryLeak()
+.expect(Status::MEMORY_LIMIT_EXCEEDED)
+.body([] {
+    std::thread t([] { recurse(256); });
+    t.join();
+});
+
+// mapped by the body, and unmapped once the working set is measured
+static char *workingSetRegion;
+
+unit("unit-test", "working-set")
+.workingSet()
+.body([] {
+    size_t sz = 64 * getpagesize();
+
+    workingSetRegion = (char *) mmap(nullptr, sz, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    assert(workingSetRegion != MAP_FAILED);
+
+    for (size_t i = 0; i < sz; i += getpagesize()) workingSetRegion[i] = 1;
+})
+.onComplete([] {
+    checkReport(
+        [] { return dtest::sandbox().workingSet(); },
+        [] (const std::string &report) {
+            // every touched page is referenced, and faulted in
+            assert(report.find("\"referenced\"") != std::string::npos);
+            assert(jsonNumber(report, "referenced") >= 64 * getpagesize());
+            assert(jsonNumber(report, "minor") >= 64);
+        }
+    );
+
+    munmap(workingSetRegion, 64 * getpagesize());
+});
+
+unit("unit-test", "histogram-percentiles")
+.body([] {
+    // both histograms take the percentile as a fraction
+    dtest::LatencyHistogram latency;
+    dtest::Log2Histogram log2;
+
+    for (uint64_t i = 1; i <= 1000; ++i) {
+        latency.record(i);
+        log2.add(i);
+    }
+
+    assert(latency.percentile(0.5) >= 500 && latency.percentile(0.5) <= 510);
+    assert(latency.percentile(1) == 1000);
+    assert(log2.percentile(0.5) == 256);
+    assert(log2.percentile(1) == 512);
+});
+
+unit("unit-test", "counters")
+.counters()
+.body([] {
+    dtest::CounterValues start, end;
+    dtest::sandbox().readCounters(start);
+
+    volatile uint64_t sum = 0;
+    for (int i = 0; i < 1000000; ++i) sum += i;
+
+    dtest::sandbox().readCounters(end);
+
+    // the software events are counted even without a PMU
+    auto used = end - start;
+    assert(used.has(dtest::CounterValues::TASK_CLOCK));
+    assert(! used.hardware() || used.value[dtest::CounterValues::INSTRUCTIONS] >= 1000000);
+});
+
+unit("unit-test", "counters-context-switches")
+.counters()
+.body([] {
+    dtest::CounterValues start, end;
+    dtest::sandbox().readCounters(start);
+
+    for (int i = 0; i < 20; ++i) usleep(100);
+
+    dtest::sandbox().readCounters(end);
+
+    // every sleep switches out, which is only seen by the perf event
+    auto used = end - start;
+    assert(! used.has(dtest::CounterValues::CONTEXT_SWITCHES) || used.value[dtest::CounterValues::CONTEXT_SWITCHES] >= 20);
+});
+
+unit("unit-test", "allocator-overhead")
+.allocatorOverhead()
+.resourceSnapshotBodyOnly()
+.body([] {
+    std::vector<void *> blocks;
+    blocks.reserve(300);
+
+    for (size_t i = 1; i <= 300; ++i) blocks.push_back(malloc(i));
+
+    // dominates the peak, so that the resident growth follows the live bytes
+    size_t sz = 16 << 20;
+    char *big = (char *) malloc(sz);
+    memset(big, 1, sz);
+    free(big);
+
+    for (auto p : blocks) free(p);
+})
+.onComplete([] {
+    checkReport(
+        [] { return dtest::sandbox().memoryOverhead(); },
+        [] (const std::string &report) {
+            assert(jsonNumber(report, "usable") >= jsonNumber(report, "requested"));
+            assert(jsonNumber(report, "live") >= 16 << 20);
+
+            auto ratio = jsonNumber(report, "ratio");
+            assert(ratio > 0.9 && ratio < 1.5);
+        }
+    );
+});
+
+static void allocatorWorkload() {
+    std::vector<std::vector<int>> v;
+    for (auto i = 0; i < 1000; ++i) v.emplace_back(i % 64, i);
+    for (auto i = 0; i < 1000; ++i) assert(v[i].size() == (size_t) i % 64);
+
+    char *p = (char *) calloc(100, 1);
+    for (auto i = 0; i < 100; ++i) assert(p[i] == 0);
+    p = (char *) realloc(p, 10000);
+    for (auto i = 0; i < 100; ++i) assert(p[i] == 0);
+    free(p);
+
+    void *aligned = aligned_alloc(4096, 4096);
+    assert(((uintptr_t) aligned & 4095) == 0);
+    assert(malloc_usable_size(aligned) >= 4096);
+    free(aligned);
+
+    std::thread t([] { delete new int; });
+    t.join();
+}
+
+unit("unit-test", "allocator-arena")
+.allocator(dtest::Allocator::ARENA)
+.ignoreMemoryLeak()     // thread-local storage of the new thread
+.body([] {
+    auto p = new int(0);
+    assert(dtest::allocatorOf(p) != nullptr);
+    delete p;
+
+    allocatorWorkload();
+});
+
+unit("unit-test", "allocator-thread-cache")
+.allocator(dtest::Allocator::THREAD_CACHE)
+.ignoreMemoryLeak()
+.body([] {
+    auto p = new int(0);
+    assert(dtest::allocatorOf(p) != nullptr);
+    delete p;
+
+    allocatorWorkload();
+});
+
+unit("unit-test", "allocator-tuned-libc")
+.allocator(dtest::Allocator::TUNED_LIBC)
+.ignoreMemoryLeak()
+.body(allocatorWorkload);
+
+unit("unit-test", "allocator-arena-bad-alignment")
+.allocator(dtest::Allocator::ARENA)
+.body([] {
+    // alignments that are not powers of two are left to libc
+    void *a = memalign(24, 100);
+    void *b = memalign(24, 100);
+    assert(a != nullptr && b != nullptr);
+    assert(dtest::allocatorOf(a) == nullptr);
+    assert((char *) b >= (char *) a + 100 || (char *) a >= (char *) b + 100);
+    free(a);
+    free(b);
+
+    void *c = aligned_alloc(24, 96);
+    if (c != nullptr) assert(dtest::allocatorOf(c) == nullptr);
+    free(c);
+
+    void *d = nullptr;
+    assert(posix_memalign(&d, 24, 100) == EINVAL);
+});
+
+// user code may name its own types after the allocator backends
+struct Allocator {
+    void * allocate(size_t size) { return malloc(size); }
+    void deallocate(void *ptr) { free(ptr); }
+};
+
+unit("unit-test", "allocator-identifier")
+.allocator(dtest::Allocator::ARENA)
+.body([] {
+    Allocator allocator;
+    auto p = allocator.allocate(16);
+    assert(dtest::allocatorOf(p) != nullptr);
+    allocator.deallocate(p);
+});
+
+unit("unit-test", "allocator-arena-mem-leak")
+.allocator(dtest::Allocator::ARENA)
+.expect(Status::PASS_WITH_MEMORY_LEAK)
+.body([] {
+    new int;
+});
+
+unit("unit-test", "cross-thread-frees")
+.crossThreadFrees()
+.ignoreMemoryLeak()     // thread-local storage of the new thread
+.body([] {
+    std::vector<int *> blocks;
+    blocks.reserve(100);
+    for (auto i = 0; i < 100; ++i) blocks.push_back(new int(i));
+
+    std::thread consumer([&blocks] {
+        for (auto p : blocks) delete p;
+    });
+    consumer.join();
+})
+.onComplete([] {
+    checkReport(
+        [] { return dtest::sandbox().memoryCrossThreadFrees(5); },
+        [] (const std::string &report) {
+            assert(jsonNumber(report, "blocks") >= 100);
+
+            // the body thread allocates, and the consumer frees
+            auto pair = report.find("\"allocating\": 1, \"freeing\": 2");
+            assert(pair != std::string::npos);
+            assert(jsonNumber(report.substr(pair), "blocks") >= 100);
+
+            auto site = report.substr(report.find("\"sites\""));
+            assert(jsonNumber(site, "blocks") == 100);
+            assert(jsonNumber(site, "size") == 100 * sizeof(int));
+        }
+    );
+});
+
+unit("unit-test", "raw-call-stacks")
+.body([] {
+    dtest::CallStack::rawMode(true);
+    auto raw = dtest::CallStack::trace().toString();
+    dtest::CallStack::rawMode(false);
+
+    assert(raw.find("dtest::timeOf") == std::string::npos);
+    assert(raw.find(".dtest.so+0x") != std::string::npos);
+
+    auto resolved = dtest::CallStack::symbolize(raw);
+    assert(resolved.find("dtest::timeOf") != std::string::npos);
+});